@@ -16,76 +16,81 @@
 #define MSI_EC_FW_DATE_LENGTH     8
 #define MSI_EC_FW_TIME_LENGTH     8
 
+/*
+ * EC addresses are stored as u16 to fit the MSI_EC_ADDR_* sentinels,
+ * bit numbers, masks and register values fit in a u8.
+ */
+
 struct msi_ec_webcam_conf {
-	int address;
-	int block_address;
-	int bit;
+	u16 address;
+	u16 block_address;
+	u8 bit;
 };
 
 struct msi_ec_fn_win_swap_conf {
-	int address;
-	int bit;
+	u16 address;
+	u8 bit;
 	bool invert;
 };
 
 struct msi_ec_cooler_boost_conf {
-	int address;
-	int bit;
+	u16 address;
+	u8 bit;
 };
 
 #define MSI_EC_MODE_NULL { NULL, 0 }
 struct msi_ec_mode {
 	const char *name;
-	int value;
+	u8 value;
 };
 
 #define MSI_EC_SHIFT_MODE_NAME_LIMIT 20
 struct msi_ec_shift_mode_conf {
-	int address;
+	u16 address;
 	struct msi_ec_mode modes[5]; // fixed size for easier hard coding
 };
 
 struct msi_ec_super_battery_conf {
-	int address;
-	int mask;
+	u16 address;
+	u8 mask;
 };
 
 struct msi_ec_fan_mode_conf {
-	int address;
+	u16 address;
 	struct msi_ec_mode modes[5]; // fixed size for easier hard coding
 };
 
 struct msi_ec_cpu_conf {
-	int rt_temp_address;
-	int rt_fan_speed_address; // realtime % RPM
+	u16 rt_temp_address;
+	u16 rt_fan_speed_address; // realtime % RPM
 };
 
 struct msi_ec_gpu_conf {
-	int rt_temp_address;
-	int rt_fan_speed_address; // realtime % RPM
+	u16 rt_temp_address;
+	u16 rt_fan_speed_address; // realtime % RPM
 };
 
 struct msi_ec_led_conf {
-	int micmute_led_address;
-	int mute_led_address;
-	int bit;
+	u16 micmute_led_address;
+	u16 mute_led_address;
+	u8 bit;
 };
 
 #define MSI_EC_KBD_BL_STATE_MASK 0x3
 struct msi_ec_kbd_bl_conf {
-	int bl_mode_address;
-	int bl_modes[2];
-	int max_mode;
+	u16 bl_mode_address;
+	u8 bl_modes[2];
+	u8 max_mode;
 
-	int bl_state_address;
-	int state_base_value;
-	int max_state;
+	u16 bl_state_address;
+	u8 state_base_value;
+	u8 max_state;
 };
 
 struct msi_ec_conf {
 	const char **allowed_fw;
 
-	int charge_control_address;
+	u16 charge_control_address;
 	struct msi_ec_webcam_conf         webcam;
 	struct msi_ec_fn_win_swap_conf    fn_win_swap;
 	struct msi_ec_cooler_boost_conf   cooler_boost;
@@ -98,4 +103,79 @@ struct msi_ec_conf {
 	struct msi_ec_kbd_bl_conf         kbd_bl;
 };
 
+/*
+ * Binary configuration loaded with request_firmware() from
+ * msi-ec/<firmware version>.bin for firmware versions missing from the
+ * built-in tables. The fields mirror struct msi_ec_conf, all multi-byte
+ * values are little-endian. Mode names are stored as indices into
+ * the list of MSI_EC_BLOB_MODE_* names, unused entries are zeroed.
+ */
+#define MSI_EC_BLOB_MAGIC   "MSEC"
+#define MSI_EC_BLOB_VERSION 1
+#define MSI_EC_BLOB_MODES   4
+
+enum msi_ec_blob_mode_name {
+	MSI_EC_BLOB_MODE_NONE = 0,
+	MSI_EC_BLOB_MODE_ECO,
+	MSI_EC_BLOB_MODE_COMFORT,
+	MSI_EC_BLOB_MODE_SPORT,
+	MSI_EC_BLOB_MODE_TURBO,
+	MSI_EC_BLOB_MODE_AUTO,
+	MSI_EC_BLOB_MODE_SILENT,
+	MSI_EC_BLOB_MODE_BASIC,
+	MSI_EC_BLOB_MODE_ADVANCED,
+	MSI_EC_BLOB_MODE_COUNT
+};
+
+struct msi_ec_blob_mode {
+	u8 name; // enum msi_ec_blob_mode_name
+	u8 value;
+} __packed;
+
+struct msi_ec_conf_blob {
+	char magic[4]; // MSI_EC_BLOB_MAGIC, not null-terminated
+	u8 version;    // MSI_EC_BLOB_VERSION
+	u8 reserved[3];
+	char fw[MSI_EC_FW_VERSION_LENGTH]; // firmware version, not null-terminated
+
+	__le16 charge_control_address;
+
+	__le16 webcam_address;
+	__le16 webcam_block_address;
+	u8     webcam_bit;
+
+	__le16 fn_win_swap_address;
+	u8     fn_win_swap_bit;
+	u8     fn_win_swap_invert;
+
+	__le16 cooler_boost_address;
+	u8     cooler_boost_bit;
+
+	__le16 shift_mode_address;
+	struct msi_ec_blob_mode shift_modes[MSI_EC_BLOB_MODES];
+
+	__le16 super_battery_address;
+	u8     super_battery_mask;
+
+	__le16 fan_mode_address;
+	struct msi_ec_blob_mode fan_modes[MSI_EC_BLOB_MODES];
+
+	__le16 cpu_rt_temp_address;
+	__le16 cpu_rt_fan_speed_address;
+
+	__le16 gpu_rt_temp_address;
+	__le16 gpu_rt_fan_speed_address;
+
+	__le16 micmute_led_address;
+	__le16 mute_led_address;
+	u8     leds_bit;
+
+	__le16 kbd_bl_mode_address;
+	u8     kbd_bl_modes[2];
+	u8     kbd_bl_max_mode;
+	__le16 kbd_bl_state_address;
+	u8     kbd_bl_state_base_value;
+	u8     kbd_bl_max_state;
+} __packed;
+
 #endif // __MSI_EC_REGISTERS_CONFIG__
@@ -0,0 +1,376 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-test.c - KUnit tests for the msi-ec driver.
+ *
+ * The driver sources are built into this module, so that the tests can
+ * reach its static functions, but the driver itself is not registered.
+ * Every EC access goes to the emulated EC of the mock backend, which makes
+ * the tests independent of the hardware they run on.
+ *
+ * The configuration tables only live in the init sections, so the suite
+ * checking them runs at module load. Timings are reported with kunit_info()
+ * rather than checked; load the module with e.g. cache_ms=1000 to time the
+ * cached paths.
+ */
+
+#define MSI_EC_TEST
+#include "msi-ec.c"
+
+#include <kunit/test.h>
+
+#define TEST_TIMING_LOOPS 10000
+
+// reports the average duration of a statement run TEST_TIMING_LOOPS times
+#define TEST_TIME(test, what, stmt)					\
+do {									\
+	u64 __start = ktime_get_ns();					\
+									\
+	for (int __i = 0; __i < TEST_TIMING_LOOPS; __i++)		\
+		stmt;							\
+									\
+	kunit_info(test, "%s: %llu ns\n", what,				\
+		   div_u64(ktime_get_ns() - __start, TEST_TIMING_LOOPS)); \
+} while (0)
+
+// ============================================================ //
+// Configurations
+// ============================================================ //
+
+static void __init test_conf_addresses(struct kunit *test)
+{
+	for (int i = 0; CONFIGURATIONS[i]; i++)
+		KUNIT_EXPECT_TRUE_MSG(test, conf_addresses_valid(CONFIGURATIONS[i]),
+				      "CONF%d", i);
+}
+
+static void __init check_modes(struct kunit *test, int conf_index,
+			       const char *kind,
+			       const struct msi_ec_mode *modes, int size)
+{
+	struct mode_table table;
+	size_t len = 0;
+	int count = 0;
+
+	while (count < size && modes[count].name)
+		count++;
+
+	// the lookups stop at the NULL entry
+	KUNIT_ASSERT_LT_MSG(test, count, size,
+			    "CONF%d %s modes are not NULL-terminated",
+			    conf_index, kind);
+
+	for (int i = 0; i < count; i++) {
+		for (int j = 0; j < i; j++)
+			KUNIT_EXPECT_STRNEQ_MSG(test, modes[i].name, modes[j].name,
+						"CONF%d %s modes", conf_index, kind);
+
+		len += strlen(modes[i].name) + 1;
+	}
+
+	KUNIT_EXPECT_LT_MSG(test, len, sizeof(table.available),
+			    "CONF%d available_%s_modes is truncated",
+			    conf_index, kind);
+
+	mode_table_init(&table, modes);
+	for (int i = 0; i < count; i++) {
+		const char *name = mode_table_name(&table, modes, modes[i].value);
+
+		KUNIT_ASSERT_NOT_NULL_MSG(test, name, "CONF%d %s mode %s",
+					  conf_index, kind, modes[i].name);
+
+		// modes sharing a value are shown as the first of them
+		KUNIT_EXPECT_EQ_MSG(test,
+				    modes[find_mode_by_name(modes, name)].value,
+				    modes[i].value, "CONF%d %s mode %s",
+				    conf_index, kind, modes[i].name);
+	}
+}
+
+static void __init test_conf_modes(struct kunit *test)
+{
+	for (int i = 0; CONFIGURATIONS[i]; i++) {
+		const struct msi_ec_conf *c = CONFIGURATIONS[i];
+
+		check_modes(test, i, "shift", c->shift_mode.modes,
+			    ARRAY_SIZE(c->shift_mode.modes));
+		check_modes(test, i, "fan", c->fan_mode.modes,
+			    ARRAY_SIZE(c->fan_mode.modes));
+	}
+}
+
+static void __init test_conf_firmware(struct kunit *test)
+{
+	for (int i = 0; CONFIGURATIONS[i]; i++) {
+		const char **fw = CONFIGURATIONS[i]->allowed_fw;
+
+		KUNIT_ASSERT_NOT_NULL_MSG(test, fw, "CONF%d", i);
+		KUNIT_EXPECT_NOT_NULL_MSG(test, fw[0], "CONF%d", i);
+
+		for (int j = 0; fw[j]; j++) {
+			KUNIT_EXPECT_LE_MSG(test, strlen(fw[j]),
+					    MSI_EC_FW_VERSION_LENGTH, "%s", fw[j]);
+
+			// listed once, and by no earlier configuration
+			KUNIT_EXPECT_EQ_MSG(test, match_string(fw, -1, fw[j]), j,
+					    "%s", fw[j]);
+			KUNIT_EXPECT_PTR_EQ_MSG(test, find_configuration(fw[j]),
+						CONFIGURATIONS[i], "%s", fw[j]);
+		}
+	}
+}
+
+static void __init test_conf_lookup_time(struct kunit *test)
+{
+	const char *last = NULL;
+	int found = 0;
+
+	for (int i = 0; CONFIGURATIONS[i]; i++)
+		last = CONFIGURATIONS[i]->allowed_fw[0];
+
+	KUNIT_ASSERT_NOT_NULL(test, last);
+
+	TEST_TIME(test, "find_configuration, last entry",
+		  found += !!find_configuration(last));
+	TEST_TIME(test, "find_configuration, unknown firmware",
+		  found += !!find_configuration("XXXXEMS1.000"));
+
+	KUNIT_EXPECT_EQ(test, found, TEST_TIMING_LOOPS);
+}
+
+static struct kunit_case __refdata msi_ec_conf_test_cases[] = {
+	KUNIT_CASE(test_conf_addresses),
+	KUNIT_CASE(test_conf_modes),
+	KUNIT_CASE(test_conf_firmware),
+	KUNIT_CASE(test_conf_lookup_time),
+	{}
+};
+
+static struct kunit_suite msi_ec_conf_test_suite = {
+	.name = "msi-ec-conf",
+	.test_cases = msi_ec_conf_test_cases,
+};
+
+kunit_test_init_section_suites(&msi_ec_conf_test_suite);
+
+// ============================================================ //
+// EC access and attributes, on the emulated EC
+// ============================================================ //
+
+// laid out like CONF0
+static struct msi_ec_conf test_conf = {
+	.charge_control_address = 0xef,
+	.webcam = {
+		.address       = 0x2e,
+		.block_address = 0x2f,
+		.bit           = 1,
+	},
+	.fn_win_swap = {
+		.address = 0xbf,
+		.bit     = 4,
+		.invert  = false,
+	},
+	.cooler_boost = {
+		.address = 0x98,
+		.bit     = 7,
+	},
+	.shift_mode = {
+		.address = 0xf2,
+		.modes = {
+			{ SM_ECO_NAME,     0xc2 },
+			{ SM_COMFORT_NAME, 0xc1 },
+			{ SM_SPORT_NAME,   0xc0 },
+			MSI_EC_MODE_NULL
+		},
+	},
+	.super_battery = {
+		.address = MSI_EC_ADDR_UNSUPP,
+	},
+	.fan_mode = {
+		.address = 0xf4,
+		.modes = {
+			{ FM_AUTO_NAME,     0x0d },
+			{ FM_SILENT_NAME,   0x1d },
+			{ FM_BASIC_NAME,    0x4d },
+			{ FM_ADVANCED_NAME, 0x8d },
+			MSI_EC_MODE_NULL
+		},
+	},
+	.cpu = {
+		.rt_temp_address      = 0x68,
+		.rt_fan_speed_address = 0x71,
+	},
+	.gpu = {
+		.rt_temp_address      = 0x80,
+		.rt_fan_speed_address = 0x89,
+	},
+	.leds = {
+		.micmute_led_address = 0x2b,
+		.mute_led_address    = 0x2c,
+		.bit                 = 2,
+	},
+	.kbd_bl = {
+		.bl_mode_address  = 0x2c,
+		.bl_modes         = { 0x00, 0x08 },
+		.max_mode         = 1,
+		.bl_state_address = 0xf3,
+		.state_base_value = 0x80,
+		.max_state        = 3,
+	},
+};
+
+static int msi_ec_mock_test_init(struct kunit *test)
+{
+	ec_ops = &msi_ec_mock_ops;
+	memset(ec_mock_ram, 0, sizeof(ec_mock_ram));
+
+	mutex_lock(&ec_mutex);
+	memcpy(&conf, &test_conf, sizeof(conf));
+	bitmap_zero(ec_cache_valid, MSI_EC_RAM_SIZE);
+	mutex_unlock(&ec_mutex);
+
+	conf_loaded = true;
+	mode_tables_init();
+
+	return 0;
+}
+
+// sysfs_emit() only writes to the start of a page
+static char *test_page(struct kunit *test)
+{
+	char *buf = kunit_kzalloc(test, PAGE_SIZE, GFP_KERNEL);
+
+	KUNIT_ASSERT_NOT_NULL(test, buf);
+	return buf;
+}
+
+static void test_update_bits(struct kunit *test)
+{
+	u8 addr = conf.webcam.address;
+
+	ec_mock_ram[addr] = 0xf0;
+	KUNIT_ASSERT_EQ(test, ec_update_bits(addr, 0x0f, 0x05), 0);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], 0xf5);
+
+	// bits outside of the mask are ignored
+	KUNIT_ASSERT_EQ(test, ec_update_bits(addr, 0xf0, 0x0f), 0);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], 0x05);
+
+	// toggles a bit, so that every update is a write
+	TEST_TIME(test, "ec_update_bits",
+		  ec_update_bits(addr, BIT(1), ec_mock_ram[addr] ^ BIT(1)));
+}
+
+static void test_webcam(struct kunit *test)
+{
+	u8 addr = conf.webcam.address;
+	char *buf = test_page(test);
+
+	ec_mock_ram[addr] = 0xff;
+	KUNIT_EXPECT_EQ(test, webcam_store(NULL, NULL, "off\n", 4), 4);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], 0xfd);
+	KUNIT_EXPECT_GT(test, webcam_show(NULL, NULL, buf), 0);
+	KUNIT_EXPECT_STREQ(test, buf, "off\n");
+
+	KUNIT_EXPECT_EQ(test, webcam_store(NULL, NULL, "on\n", 3), 3);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], 0xff);
+	KUNIT_EXPECT_GT(test, webcam_show(NULL, NULL, buf), 0);
+	KUNIT_EXPECT_STREQ(test, buf, "on\n");
+
+	KUNIT_EXPECT_EQ(test, webcam_store(NULL, NULL, "maybe\n", 6),
+			-EINVAL);
+
+	TEST_TIME(test, "webcam_show", webcam_show(NULL, NULL, buf));
+	TEST_TIME(test, "webcam_store",
+		  webcam_store(NULL, NULL, "on\n", 3));
+}
+
+static void test_cooler_boost(struct kunit *test)
+{
+	u8 addr = conf.cooler_boost.address;
+	char *buf = test_page(test);
+
+	KUNIT_EXPECT_EQ(test, cooler_boost_store(NULL, NULL, "on\n", 3), 3);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], BIT(7));
+	KUNIT_EXPECT_GT(test, cooler_boost_show(NULL, NULL, buf), 0);
+	KUNIT_EXPECT_STREQ(test, buf, "on\n");
+
+	TEST_TIME(test, "cooler_boost_show",
+		  cooler_boost_show(NULL, NULL, buf));
+}
+
+static void test_shift_mode(struct kunit *test)
+{
+	u8 addr = conf.shift_mode.address;
+	char *buf = test_page(test);
+
+	KUNIT_EXPECT_EQ(test, shift_mode_store(NULL, NULL, "sport\n", 6), 6);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], 0xc0);
+	KUNIT_EXPECT_GT(test, shift_mode_show(NULL, NULL, buf), 0);
+	KUNIT_EXPECT_STREQ(test, buf, "sport\n");
+
+	// not supported by this configuration
+	KUNIT_EXPECT_EQ(test, shift_mode_store(NULL, NULL, "turbo\n", 6),
+			-EINVAL);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], 0xc0);
+
+	KUNIT_EXPECT_GT(test, available_shift_modes_show(NULL, NULL, buf), 0);
+	KUNIT_EXPECT_STREQ(test, buf, "eco\ncomfort\nsport\n");
+
+	TEST_TIME(test, "shift_mode_show", shift_mode_show(NULL, NULL, buf));
+	TEST_TIME(test, "shift_mode_store",
+		  shift_mode_store(NULL, NULL, "comfort\n", 8));
+}
+
+#ifdef MSI_EC_PLATFORM_PROFILE
+static void test_platform_profile(struct kunit *test)
+{
+	bool fan_mode = READ_ONCE(platform_profile_fan_mode);
+	enum platform_profile_option profile;
+	u8 addr = conf.shift_mode.address;
+
+	// e.g. after boot, a Fn key press or a shift_mode write
+	WRITE_ONCE(msi_platform_profile_last, NULL);
+	ec_mock_ram[addr] = 0xc1; // comfort
+	KUNIT_ASSERT_EQ(test, msi_platform_profile_get(NULL, &profile), 0);
+	KUNIT_EXPECT_EQ(test, profile, PLATFORM_PROFILE_BALANCED);
+
+	// only differs from balanced by the fan mode
+	WRITE_ONCE(platform_profile_fan_mode, false);
+	KUNIT_EXPECT_EQ(test,
+			msi_platform_profile_set(NULL, PLATFORM_PROFILE_QUIET),
+			-EOPNOTSUPP);
+
+	WRITE_ONCE(platform_profile_fan_mode, true);
+	KUNIT_ASSERT_EQ(test,
+			msi_platform_profile_set(NULL, PLATFORM_PROFILE_QUIET), 0);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[addr], 0xc1);
+	KUNIT_EXPECT_EQ(test, ec_mock_ram[conf.fan_mode.address], 0x1d);
+	KUNIT_ASSERT_EQ(test, msi_platform_profile_get(NULL, &profile), 0);
+	KUNIT_EXPECT_EQ(test, profile, PLATFORM_PROFILE_QUIET);
+
+	WRITE_ONCE(platform_profile_fan_mode, fan_mode);
+	WRITE_ONCE(msi_platform_profile_last, NULL);
+}
+#endif
+
+static struct kunit_case msi_ec_mock_test_cases[] = {
+	KUNIT_CASE(test_update_bits),
+	KUNIT_CASE(test_webcam),
+	KUNIT_CASE(test_cooler_boost),
+	KUNIT_CASE(test_shift_mode),
+#ifdef MSI_EC_PLATFORM_PROFILE
+	KUNIT_CASE(test_platform_profile),
+#endif
+	{}
+};
+
+static struct kunit_suite msi_ec_mock_test_suite = {
+	.name = "msi-ec-mock",
+	.init = msi_ec_mock_test_init,
+	.test_cases = msi_ec_mock_test_cases,
+};
+
+kunit_test_suite(msi_ec_mock_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests for the MSI Embedded Controller driver");
@@ -14,7 +14,8 @@
  *   charge_control_end_threshold
  *
  * This driver also registers available led class devices for
- * mute, micmute and keyboard_backlight leds
+ * mute, micmute and keyboard_backlight leds, and a hwmon device with
+ * the CPU and GPU temperatures and fan speeds
  *
  * This driver might not work on other laptops produced by MSI. Also, and until
  * future enhancements, no DMI data are used to identify your compatibility
@@ -27,10 +28,14 @@
 
 #include <acpi/battery.h>
 #include <linux/acpi.h>
+#include <linux/debugfs.h>
+#include <linux/firmware.h>
+#include <linux/hwmon.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/moduleparam.h>
+#include <linux/percpu.h>
 #include <linux/platform_device.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
@@ -39,10 +44,27 @@
 #include <linux/version.h>
 #include <linux/rtc.h>
 #include <linux/string_choices.h>
+#include <linux/timekeeping.h>
+#include <linux/workqueue.h>
+
+// the handler API before 6.14 differs from one release to the next
+#if IS_ENABLED(CONFIG_ACPI_PLATFORM_PROFILE) && \
+	(LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0))
+#define MSI_EC_PLATFORM_PROFILE
+#include <linux/platform_profile.h>
+#endif
 
-static DEFINE_MUTEX(ec_set_by_mask_mutex);
-static DEFINE_MUTEX(ec_unset_by_mask_mutex);
-static DEFINE_MUTEX(ec_set_bit_mutex);
+/*
+ * msi-ec-test.c includes this file to build the KUnit module, which must
+ * neither register a second copy of the trace events nor the driver.
+ */
+#ifdef MSI_EC_TEST
+#define trace_msi_ec_read(...)  do { } while (0)
+#define trace_msi_ec_write(...) do { } while (0)
+#else
+#define CREATE_TRACE_POINTS
+#include "msi_ec_trace.h"
+#endif
 
 #define SM_ECO_NAME		"eco"
 #define SM_COMFORT_NAME		"comfort"
@@ -3213,6 +3235,8 @@ static struct msi_ec_conf conf; // current configuration
 
 static bool charge_control_supported = false;
 
+static struct platform_device *msi_platform_device;
+
 static char *firmware = NULL;
 module_param(firmware, charp, 0);
 MODULE_PARM_DESC(firmware, "Load a configuration for a specified firmware version");
@@ -3221,245 +3245,873 @@ static bool debug = false;
 module_param(debug, bool, 0);
 MODULE_PARM_DESC(debug, "Load the driver in the debug mode, exporting the debug attributes");
 
+static unsigned int cache_ms = 0;
+module_param(cache_ms, uint, 0644);
+MODULE_PARM_DESC(cache_ms, "Serve read-only attributes from EC values not older than this many milliseconds (0 - disabled)");
+
+static unsigned int shadow_ms = 0;
+module_param(shadow_ms, uint, 0644);
+MODULE_PARM_DESC(shadow_ms, "Keep a write-through copy of the webcam, Fn/Win key and LED registers, resynchronized with the EC after this many milliseconds (0 - disabled)");
+
+static unsigned int sampler_ms = 0;
+module_param(sampler_ms, uint, 0444);
+MODULE_PARM_DESC(sampler_ms, "Sample the temperatures and fan speeds into a ring buffer every this many milliseconds (0 - disabled)");
+
+static unsigned int temp_ema_alpha = 10;
+module_param(temp_ema_alpha, uint, 0644);
+MODULE_PARM_DESC(temp_ema_alpha, "Weight of a new sample in the temperature moving averages, in percent (1-100)");
+
+static bool temp_stats_reset_on_read = false;
+module_param(temp_stats_reset_on_read, bool, 0644);
+MODULE_PARM_DESC(temp_stats_reset_on_read, "Reset the temperature statistics every time they are read");
+
+static bool platform_profile_fan_mode = false;
+module_param(platform_profile_fan_mode, bool, 0644);
+MODULE_PARM_DESC(platform_profile_fan_mode, "Also switch the fan mode when the platform profile changes");
+
+static bool mock = false;
+module_param(mock, bool, 0);
+MODULE_PARM_DESC(mock, "Use a RAM-backed EC emulation instead of the ACPI EC, for development without MSI hardware (requires firmware=)");
+
+static unsigned int kbd_bl_debounce_ms = 0;
+module_param(kbd_bl_debounce_ms, uint, 0644);
+MODULE_PARM_DESC(kbd_bl_debounce_ms, "Only write the keyboard backlight brightness once it has been stable for this many milliseconds (0 - disabled)");
+
+static bool async_writes = false;
+module_param(async_writes, bool, 0644);
+MODULE_PARM_DESC(async_writes, "Return from attribute writes immediately and apply them to the EC in the background, merging writes to the same register");
+
 // ============================================================ //
-// Helper functions
+// EC access and snapshot cache
 // ============================================================ //
 
-static int ec_read_seq(u8 addr, u8 *buf, u8 len)
+#define MSI_EC_RAM_SIZE 256
+
+/*
+ * The EC transaction lock. Serializes the EC accesses made by the driver
+ * and protects the cache. Holding it across a read-modify-write sequence
+ * makes the sequence atomic with respect to the rest of the driver.
+ */
+static DEFINE_MUTEX(ec_mutex);
+static u8 ec_cache_data[MSI_EC_RAM_SIZE];
+static unsigned long ec_cache_stamp[MSI_EC_RAM_SIZE]; // jiffies of the last read
+static DECLARE_BITMAP(ec_cache_valid, MSI_EC_RAM_SIZE);
+
+/*
+ * Read coalescing: every cached read takes a ticket before waiting for
+ * ec_mutex, and every cache update records the last ticket handed out.
+ * A reader whose ticket is not newer than that of the cached value
+ * arrived before the value was read, so it can take it as its own result
+ * instead of issuing another EC transaction, whatever the cache age.
+ */
+static atomic_long_t ec_read_ticket;
+static unsigned long ec_cache_ticket[MSI_EC_RAM_SIZE];
+
+/*
+ * Every EC transaction made by the driver goes through ec_read_raw() and
+ * ec_write_raw(), which emit the msi_ec tracepoints and account the access
+ * in the per-address counters and the latency histograms shown in
+ * debugfs (msi-ec/ec_stats). These are per CPU too, and only allocated
+ * when debugfs is available.
+ */
+#define EC_LATENCY_BUCKETS 20 // log2 of microseconds, the last one is open-ended
+
+struct ec_addr_stats {
+	unsigned long reads[MSI_EC_RAM_SIZE];
+	unsigned long writes[MSI_EC_RAM_SIZE];
+	unsigned long errors[MSI_EC_RAM_SIZE];
+	unsigned long read_latency[EC_LATENCY_BUCKETS];
+	unsigned long write_latency[EC_LATENCY_BUCKETS];
+};
+
+static struct ec_addr_stats __percpu *ec_addr_stats;
+
+// sums up a field of the per-address stats over all CPUs
+#define ec_addr_stats_sum(field)					\
+({									\
+	unsigned long __sum = 0;					\
+	int __cpu;							\
+									\
+	for_each_possible_cpu(__cpu)					\
+		__sum += READ_ONCE(per_cpu_ptr(ec_addr_stats, __cpu)->field); \
+	__sum;								\
+})
+
+/*
+ * Driver-wide totals, kept per CPU so that they can stay enabled in
+ * production, summed up by the stats attribute.
+ */
+struct ec_counters {
+	unsigned long reads;
+	unsigned long writes;
+	unsigned long errors;
+	unsigned long timeouts; // -ETIME, included in errors
+	unsigned long busy; // -EBUSY, included in errors
+	unsigned long cache_hits;
+	unsigned long coalesced; // reads served by a concurrent read
+};
+
+static DEFINE_PER_CPU(struct ec_counters, ec_counters);
+
+static void ec_stats_account(u8 addr, bool write, int result, u64 duration_ns)
 {
-	int result;
-	for (u8 i = 0; i < len; i++) {
-		result = ec_read(addr + i, buf + i);
+	struct ec_addr_stats __percpu *stats = READ_ONCE(ec_addr_stats);
+
+	if (stats) {
+		int bucket = min(fls64(div_u64(duration_ns, NSEC_PER_USEC)),
+				 EC_LATENCY_BUCKETS - 1);
+
+		if (write) {
+			this_cpu_inc(stats->writes[addr]);
+			this_cpu_inc(stats->write_latency[bucket]);
+		} else {
+			this_cpu_inc(stats->reads[addr]);
+			this_cpu_inc(stats->read_latency[bucket]);
+		}
+
 		if (result < 0)
-			return result;
+			this_cpu_inc(stats->errors[addr]);
+	}
+
+	if (write)
+		this_cpu_inc(ec_counters.writes);
+	else
+		this_cpu_inc(ec_counters.reads);
+
+	if (result < 0) {
+		this_cpu_inc(ec_counters.errors);
+		if (result == -ETIME)
+			this_cpu_inc(ec_counters.timeouts);
+		else if (result == -EBUSY)
+			this_cpu_inc(ec_counters.busy);
 	}
+}
+
+/*
+ * EC backends. The ACPI EC is used unless the module is loaded with mock=1,
+ * which replaces it with a zero-filled emulated EC RAM, so that the driver
+ * can be exercised on any machine.
+ */
+struct msi_ec_ops {
+	int (*read)(u8 addr, u8 *out);
+	int (*write)(u8 addr, u8 data);
+};
+
+static const struct msi_ec_ops msi_ec_acpi_ops = {
+	.read = ec_read,
+	.write = ec_write,
+};
+
+static u8 ec_mock_ram[MSI_EC_RAM_SIZE];
+
+static int ec_mock_read(u8 addr, u8 *out)
+{
+	*out = READ_ONCE(ec_mock_ram[addr]);
 	return 0;
 }
 
-static int ec_set_by_mask(u8 addr, u8 mask)
+static int ec_mock_write(u8 addr, u8 data)
 {
-	int result;
-	u8 stored;
+	WRITE_ONCE(ec_mock_ram[addr], data);
+	return 0;
+}
 
-	mutex_lock(&ec_set_by_mask_mutex);
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		goto unlock;
+static const struct msi_ec_ops msi_ec_mock_ops = {
+	.read = ec_mock_read,
+	.write = ec_mock_write,
+};
 
-	stored |= mask;
-	result = ec_write(addr, stored);
+static const struct msi_ec_ops *ec_ops = &msi_ec_acpi_ops;
+
+/*
+ * Never inlined, so that _RET_IP_ always points into the function that
+ * made the EC access and not into one of its callers.
+ */
+static noinline int ec_read_raw(u8 addr, u8 *out)
+{
+	ktime_t start = ktime_get();
+	int result = ec_ops->read(addr, out);
+	u64 duration_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	trace_msi_ec_read(addr, result < 0 ? 0 : *out, result, duration_ns,
+			  _RET_IP_);
+	ec_stats_account(addr, false, result, duration_ns);
 
-unlock:
-	mutex_unlock(&ec_set_by_mask_mutex);
 	return result;
 }
 
-static int ec_unset_by_mask(u8 addr, u8 mask)
+static noinline int ec_write_raw(u8 addr, u8 data)
 {
-	int result;
-	u8 stored;
-
-	mutex_lock(&ec_unset_by_mask_mutex);
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		goto unlock;
+	ktime_t start = ktime_get();
+	int result = ec_ops->write(addr, data);
+	u64 duration_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
 
-	stored &= ~mask;
-	result = ec_write(addr, stored);
+	trace_msi_ec_write(addr, data, result, duration_ns, _RET_IP_);
+	ec_stats_account(addr, true, result, duration_ns);
 
-unlock:
-	mutex_unlock(&ec_unset_by_mask_mutex);
 	return result;
 }
 
-static int ec_check_by_mask(u8 addr, u8 mask, bool *output)
+/*
+ * Control registers are only expected to change when the driver writes
+ * them. With shadow_ms set, their cached copies are updated on write
+ * instead of being dropped, serve the shows and the read-modify-write
+ * sequences, and are resynchronized with the EC after shadow_ms.
+ */
+static DECLARE_BITMAP(ec_shadowed, MSI_EC_RAM_SIZE);
+
+/*
+ * Pinned registers are shadowed regardless of shadow_ms, and their copy
+ * is trusted for EC_PINNED_MS, so that changes made behind the driver's
+ * back (e.g. by the firmware) are picked up eventually.
+ */
+#define EC_PINNED_MS 5000
+
+static DECLARE_BITMAP(ec_pinned, MSI_EC_RAM_SIZE);
+
+static bool ec_shadow_active(u8 addr)
+{
+	return test_bit(addr, ec_pinned) ||
+	       (READ_ONCE(shadow_ms) && test_bit(addr, ec_shadowed));
+}
+
+static unsigned int ec_cache_max_age(u8 addr)
+{
+	if (test_bit(addr, ec_pinned))
+		return EC_PINNED_MS;
+
+	return ec_shadow_active(addr) ? READ_ONCE(shadow_ms)
+				      : READ_ONCE(cache_ms);
+}
+
+static void __ec_cache_store(u8 addr, u8 data)
 {
+	ec_cache_data[addr] = data;
+	ec_cache_stamp[addr] = jiffies;
+	ec_cache_ticket[addr] = atomic_long_read(&ec_read_ticket);
+	__set_bit(addr, ec_cache_valid);
+}
+
+// reads a byte through the cache, must be called with ec_mutex held
+static int __ec_read_cached(u8 addr, u8 *out)
+{
+	unsigned int max_age = ec_cache_max_age(addr);
 	int result;
-	u8 stored;
 
-	result = ec_read(addr, &stored);
+	lockdep_assert_held(&ec_mutex);
+
+	if (test_bit(addr, ec_cache_valid) && max_age &&
+	    time_before(jiffies, ec_cache_stamp[addr] + msecs_to_jiffies(max_age))) {
+		*out = ec_cache_data[addr];
+		this_cpu_inc(ec_counters.cache_hits);
+		return 0;
+	}
+
+	result = ec_read_raw(addr, out);
 	if (result < 0)
 		return result;
 
-	*output = ((stored & mask) == mask);
-
+	__ec_cache_store(addr, *out);
 	return 0;
 }
 
-static int ec_set_bit(u8 addr, u8 bit, bool value)
+/*
+ * Reads a byte, serving it from the cache if it is fresh enough or if it
+ * was read while this reader was waiting for the lock.
+ */
+static int ec_read_cached(u8 addr, u8 *out)
 {
+	unsigned long ticket = atomic_long_inc_return(&ec_read_ticket);
 	int result;
-	u8 stored;
 
-	mutex_lock(&ec_set_bit_mutex);
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		goto unlock;
+	mutex_lock(&ec_mutex);
+	if (test_bit(addr, ec_cache_valid) &&
+	    (long)(ec_cache_ticket[addr] - ticket) >= 0) {
+		*out = ec_cache_data[addr];
+		this_cpu_inc(ec_counters.coalesced);
+		result = 0;
+	} else {
+		result = __ec_read_cached(addr, out);
+	}
+	mutex_unlock(&ec_mutex);
 
-	if (value)
-		stored |= BIT(bit);
-	else
-		stored &= ~BIT(bit);
+	return result;
+}
+
+/*
+ * Writes a byte and drops its cached copy, or updates it for shadowed
+ * registers. Must be called with ec_mutex held.
+ */
+static int __ec_write_cached(u8 addr, u8 data)
+{
+	int result;
 
-	result = ec_write(addr, stored);
+	lockdep_assert_held(&ec_mutex);
+
+	result = ec_write_raw(addr, data);
+	if (result == 0 && ec_shadow_active(addr))
+		__ec_cache_store(addr, data);
+	else
+		__clear_bit(addr, ec_cache_valid);
 
-unlock:
-	mutex_unlock(&ec_set_bit_mutex);
 	return result;
 }
 
-static int ec_check_bit(u8 addr, u8 bit, bool *output)
+static int ec_write_cached(u8 addr, u8 data)
 {
 	int result;
-	u8 stored;
 
-	result = ec_read(addr, &stored);
-	if (result < 0)
-		return result;
+	mutex_lock(&ec_mutex);
+	result = __ec_write_cached(addr, data);
+	mutex_unlock(&ec_mutex);
 
-	*output = stored & BIT(bit);
+	return result;
+}
 
-	return 0;
+/*
+ * Replaces the bits selected by mask with the ones from value in a single
+ * read-modify-write sequence, must be called with ec_mutex held.
+ * Shadowed registers use the shadow copy, and writes that wouldn't change
+ * the stored value are skipped.
+ */
+// reads the value a read-modify-write starts from, with ec_mutex held
+static int __ec_read_stored(u8 addr, u8 *stored)
+{
+	if (ec_shadow_active(addr))
+		return __ec_read_cached(addr, stored);
+
+	return ec_read_raw(addr, stored);
 }
 
-static int ec_get_firmware_version(u8 buf[MSI_EC_FW_VERSION_LENGTH + 1])
+static int __ec_update_bits(u8 addr, u8 mask, u8 value)
 {
 	int result;
+	u8 stored, updated;
 
-	memset(buf, 0, MSI_EC_FW_VERSION_LENGTH + 1);
-	result = ec_read_seq(MSI_EC_FW_VERSION_ADDRESS, buf,
-			     MSI_EC_FW_VERSION_LENGTH);
+	lockdep_assert_held(&ec_mutex);
+
+	result = __ec_read_stored(addr, &stored);
 	if (result < 0)
 		return result;
 
-	return MSI_EC_FW_VERSION_LENGTH + 1;
-}
+	updated = (stored & ~mask) | (value & mask);
+	if (updated == stored)
+		return 0;
 
-static inline const char *str_left_right(bool v)
-{
-	return v ? "left" : "right";
+	return __ec_write_cached(addr, updated);
 }
 
-static int direction_is_left(const char *s, bool *res)
+static int ec_update_bits(u8 addr, u8 mask, u8 value)
 {
-	if (!s)
-		return -EINVAL;
+	int result;
 
-	switch (s[0]) {
-	case 'l':
-	case 'L':
-		*res = true;
-		return 0;
-	case 'r':
-	case 'R':
-		*res = false;
-		return 0;
-	default:
-		break;
-	}
+	mutex_lock(&ec_mutex);
+	result = __ec_update_bits(addr, mask, value);
+	mutex_unlock(&ec_mutex);
 
-	return -EINVAL;
+	return result;
 }
 
 // ============================================================ //
-// Sysfs power_supply subsystem
+// Deferred writes
 // ============================================================ //
 
-static int get_end_threshold(u8 *out)
+/*
+ * With async_writes set, the store handlers only record the requested
+ * bits and return. An ordered work item applies the pending updates one
+ * register at a time, in submission order; updates of a register that is
+ * still pending are merged into it, so a burst of writes costs a single
+ * EC transaction. The outcome is reported through the write_status
+ * attribute.
+ */
+static struct workqueue_struct *ec_write_wq; // protected by ec_write_lock
+static DEFINE_SPINLOCK(ec_write_lock);
+static DECLARE_BITMAP(ec_write_pending, MSI_EC_RAM_SIZE);
+static u8 ec_write_fifo[MSI_EC_RAM_SIZE]; // pending addresses, oldest first
+static unsigned int ec_write_fifo_head;
+static unsigned int ec_write_fifo_len;
+static u8 ec_write_mask[MSI_EC_RAM_SIZE];
+static u8 ec_write_value[MSI_EC_RAM_SIZE];
+static unsigned int ec_write_queued; // pending and in-flight updates
+static int ec_write_error; // first error since the last status read
+
+static void ec_write_work_fn(struct work_struct *work)
 {
-	u8 rdata;
+	unsigned long addr;
+	u8 mask, value;
 	int result;
 
-	result = ec_read(conf.charge_control_address, &rdata);
-	if (result < 0)
-		return result;
+	for (;;) {
+		spin_lock(&ec_write_lock);
+		if (!ec_write_fifo_len) {
+			spin_unlock(&ec_write_lock);
+			break;
+		}
+		addr = ec_write_fifo[ec_write_fifo_head];
+		ec_write_fifo_head = (ec_write_fifo_head + 1) % MSI_EC_RAM_SIZE;
+		ec_write_fifo_len--;
+		__clear_bit(addr, ec_write_pending);
+		mask = ec_write_mask[addr];
+		value = ec_write_value[addr];
+		spin_unlock(&ec_write_lock);
+
+		result = ec_update_bits(addr, mask, value);
+		if (result < 0)
+			pr_warn("deferred write to 0x%02lx failed: %d\n",
+				addr, result);
+
+		spin_lock(&ec_write_lock);
+		ec_write_queued--;
+		if (result < 0 && !ec_write_error)
+			ec_write_error = result;
+		spin_unlock(&ec_write_lock);
+	}
 
-	rdata &= ~BIT(7); // last 7 bits contain the threshold
+	sysfs_notify(&msi_platform_device->dev.kobj, NULL, "write_status");
+}
 
-	// the thresholds are unknown
-	if (rdata == 0)
-		return -ENODATA;
+static DECLARE_WORK(ec_write_work, ec_write_work_fn);
 
-	if (rdata < 10 || rdata > 100)
-		return -EINVAL;
+/*
+ * Bit update for the store handlers: deferred when async_writes is set,
+ * otherwise (or if the workqueue couldn't be created) applied right away.
+ */
+static int ec_store_bits(u8 addr, u8 mask, u8 value)
+{
+	if (!READ_ONCE(async_writes))
+		return ec_update_bits(addr, mask, value);
+
+	spin_lock(&ec_write_lock);
+	if (!ec_write_wq) {
+		spin_unlock(&ec_write_lock);
+		return ec_update_bits(addr, mask, value);
+	}
+
+	if (__test_and_set_bit(addr, ec_write_pending)) {
+		ec_write_mask[addr] |= mask;
+		ec_write_value[addr] &= ~mask;
+		ec_write_value[addr] |= value & mask;
+	} else {
+		ec_write_fifo[(ec_write_fifo_head + ec_write_fifo_len) %
+			      MSI_EC_RAM_SIZE] = addr;
+		ec_write_fifo_len++;
+		ec_write_mask[addr] = mask;
+		ec_write_value[addr] = value & mask;
+		ec_write_queued++;
+	}
+
+	// under the lock, so that the workqueue can't be destroyed meanwhile
+	queue_work(ec_write_wq, &ec_write_work);
+	spin_unlock(&ec_write_lock);
 
-	*out = rdata;
 	return 0;
 }
 
-static int set_end_threshold(u8 value)
+/*
+ * Applies the queued stores before a synchronous write, so that none of
+ * them overwrites a value written after it. Must be called neither with
+ * ec_mutex held nor from the write work.
+ */
+static void ec_write_flush(void)
 {
-	if (value < 10 || value > 100)
-		return -EINVAL;
-
-	return ec_write(conf.charge_control_address, value | BIT(7));
+	flush_work(&ec_write_work);
 }
 
-static ssize_t
-charge_control_start_threshold_show(struct device *device,
-				    struct device_attribute *attr, char *buf)
+static void ec_write_wq_init(void)
 {
-	int result;
-	u8 threshold;
-
-	result = get_end_threshold(&threshold);
+	struct workqueue_struct *wq;
 
-	if (result == -ENODATA)
-		return sysfs_emit(buf, "0\n");
-	else if (result < 0)
-		return result;
+	wq = alloc_ordered_workqueue("msi_ec_write", 0);
+	if (!wq) {
+		pr_warn("async writes unavailable, writing synchronously\n");
+		return;
+	}
 
-	return sysfs_emit(buf, "%u\n", threshold - 10);
+	spin_lock(&ec_write_lock);
+	ec_write_wq = wq;
+	spin_unlock(&ec_write_lock);
 }
 
-static ssize_t
-charge_control_start_threshold_store(struct device *dev,
-				     struct device_attribute *attr,
-				     const char *buf, size_t count)
+/*
+ * Applies the pending writes before returning. Later stores are applied
+ * synchronously, so the attributes may outlive the workqueue.
+ */
+static void ec_write_wq_exit(void)
 {
-	int result;
-	u8 threshold;
-
-	result = kstrtou8(buf, 10, &threshold);
-	if (result < 0)
-		return result;
+	struct workqueue_struct *wq;
 
-	result = set_end_threshold(threshold + 10);
-	if (result < 0)
-		return result;
+	spin_lock(&ec_write_lock);
+	wq = ec_write_wq;
+	ec_write_wq = NULL;
+	spin_unlock(&ec_write_lock);
 
-	return count;
+	if (wq)
+		destroy_workqueue(wq);
 }
 
-static ssize_t charge_control_end_threshold_show(struct device *device,
-						 struct device_attribute *attr,
-						 char *buf)
+// ============================================================ //
+// Helper functions
+// ============================================================ //
+
+/*
+ * Reads a contiguous range of EC memory in a single pass. The EC lock is
+ * taken once for the whole range, so cached readers and invalidating writers
+ * never observe a half-updated range. The values read refresh the cache.
+ */
+static int ec_read_seq(u8 addr, u8 *buf, size_t len)
 {
-	int result;
-	u8 threshold;
+	int result = 0;
 
-	result = get_end_threshold(&threshold);
+	if (addr + len > MSI_EC_RAM_SIZE)
+		return -EINVAL;
 
-	if (result == -ENODATA)
-		return sysfs_emit(buf, "0\n");
-	else if (result < 0)
-		return result;
+	mutex_lock(&ec_mutex);
+	for (size_t i = 0; i < len; i++) {
+		result = ec_read_raw(addr + i, buf + i);
+		if (result < 0)
+			goto unlock;
+	}
 
-	return sysfs_emit(buf, "%u\n", threshold);
+	for (size_t i = 0; i < len; i++)
+		__ec_cache_store(addr + i, buf[i]);
+
+unlock:
+	mutex_unlock(&ec_mutex);
+	return result;
 }
 
-static ssize_t charge_control_end_threshold_store(struct device *dev,
-						  struct device_attribute *attr,
-						  const char *buf, size_t count)
+// writes a contiguous range of EC memory in a single pass
+static int ec_write_seq(u8 addr, const u8 *buf, size_t len)
 {
-	int result;
-	u8 threshold;
+	int result = 0;
 
-	result = kstrtou8(buf, 10, &threshold);
-	if (result < 0)
-		return result;
+	if (addr + len > MSI_EC_RAM_SIZE)
+		return -EINVAL;
 
-	result = set_end_threshold(threshold);
+	mutex_lock(&ec_mutex);
+	for (size_t i = 0; i < len; i++) {
+		result = __ec_write_cached(addr + i, buf[i]);
+		if (result < 0)
+			break;
+	}
+	mutex_unlock(&ec_mutex);
+
+	return result;
+}
+
+/*
+ * Reads a list of possibly scattered EC addresses in a single pass,
+ * refreshing the cache. Unsupported addresses are skipped and read as 0.
+ */
+static int ec_read_list(const int *addrs, u8 *buf, size_t len)
+{
+	int result = 0;
+
+	mutex_lock(&ec_mutex);
+	for (size_t i = 0; i < len; i++) {
+		u8 addr = addrs[i];
+
+		buf[i] = 0;
+		if (addrs[i] == MSI_EC_ADDR_UNSUPP)
+			continue;
+
+		result = ec_read_raw(addr, buf + i);
+		if (result < 0)
+			break;
+
+		__ec_cache_store(addr, buf[i]);
+	}
+	mutex_unlock(&ec_mutex);
+
+	return result;
+}
+
+/*
+ * A batch of EC writes applied together. Each entry replaces the bits
+ * selected by mask at a single address; entries for the same address are
+ * merged, so every address is read and written at most once.
+ */
+#define EC_BATCH_MAX 12
+
+struct ec_batch {
+	int count;
+	struct {
+		u8 addr;
+		u8 mask;
+		u8 value;
+	} ops[EC_BATCH_MAX];
+};
+
+static int ec_batch_add(struct ec_batch *batch, u8 addr, u8 mask, u8 value)
+{
+	for (int i = 0; i < batch->count; i++) {
+		if (batch->ops[i].addr != addr)
+			continue;
+
+		batch->ops[i].mask |= mask;
+		batch->ops[i].value &= ~mask;
+		batch->ops[i].value |= value & mask;
+		return 0;
+	}
+
+	if (batch->count == EC_BATCH_MAX)
+		return -E2BIG;
+
+	batch->ops[batch->count].addr = addr;
+	batch->ops[batch->count].mask = mask;
+	batch->ops[batch->count].value = value & mask;
+	batch->count++;
+
+	return 0;
+}
+
+/*
+ * Applies a batch without other driver accesses in between. It stops at
+ * the first failed access and restores the previous values of the
+ * registers already written, so that a batch isn't left half applied;
+ * the restore itself may fail if the EC keeps failing.
+ */
+static int ec_batch_commit(const struct ec_batch *batch)
+{
+	u8 stored[EC_BATCH_MAX];
+	bool written[EC_BATCH_MAX] = {};
+	int result = 0;
+
+	mutex_lock(&ec_mutex);
+	for (int i = 0; i < batch->count; i++) {
+		u8 addr = batch->ops[i].addr;
+		u8 mask = batch->ops[i].mask;
+		u8 updated;
+
+		result = __ec_read_stored(addr, &stored[i]);
+		if (result < 0)
+			break;
+
+		updated = (stored[i] & ~mask) | (batch->ops[i].value & mask);
+		if (updated == stored[i])
+			continue;
+
+		result = __ec_write_cached(addr, updated);
+		if (result < 0)
+			break;
+
+		written[i] = true;
+	}
+
+	for (int i = 0; result < 0 && i < batch->count; i++) {
+		if (written[i] &&
+		    __ec_write_cached(batch->ops[i].addr, stored[i]) < 0)
+			pr_warn("failed to restore 0x%02x after a failed batch\n",
+				batch->ops[i].addr);
+	}
+	mutex_unlock(&ec_mutex);
+
+	return result;
+}
+
+static int ec_set_by_mask(u8 addr, u8 mask)
+{
+	return ec_store_bits(addr, mask, mask);
+}
+
+static int ec_unset_by_mask(u8 addr, u8 mask)
+{
+	return ec_store_bits(addr, mask, 0);
+}
+
+static int ec_check_by_mask(u8 addr, u8 mask, bool *output)
+{
+	int result;
+	u8 stored;
+
+	result = ec_read_cached(addr, &stored);
+	if (result < 0)
+		return result;
+
+	*output = ((stored & mask) == mask);
+
+	return 0;
+}
+
+static int ec_set_bit(u8 addr, u8 bit, bool value)
+{
+	return ec_store_bits(addr, BIT(bit), value ? BIT(bit) : 0);
+}
+
+static int ec_check_bit(u8 addr, u8 bit, bool *output)
+{
+	int result;
+	u8 stored;
+
+	result = ec_read_cached(addr, &stored);
+	if (result < 0)
+		return result;
+
+	*output = stored & BIT(bit);
+
+	return 0;
+}
+
+static int ec_get_firmware_version(u8 buf[MSI_EC_FW_VERSION_LENGTH + 1])
+{
+	int result;
+
+	memset(buf, 0, MSI_EC_FW_VERSION_LENGTH + 1);
+	result = ec_read_seq(MSI_EC_FW_VERSION_ADDRESS, buf,
+			     MSI_EC_FW_VERSION_LENGTH);
+	if (result < 0)
+		return result;
+
+	return MSI_EC_FW_VERSION_LENGTH + 1;
+}
+
+// returns the index of the mode with the given name, or -EINVAL
+static int find_mode_by_name(const struct msi_ec_mode *modes, const char *name)
+{
+	for (int i = 0; modes[i].name; i++) {
+		// NULL entries have NULL name
+
+		if (sysfs_streq(modes[i].name, name))
+			return i;
+	}
+
+	return -EINVAL;
+}
+
+static inline const char *str_left_right(bool v)
+{
+	return v ? "left" : "right";
+}
+
+static int direction_is_left(const char *s, bool *res)
+{
+	if (!s)
+		return -EINVAL;
+
+	switch (s[0]) {
+	case 'l':
+	case 'L':
+		*res = true;
+		return 0;
+	case 'r':
+	case 'R':
+		*res = false;
+		return 0;
+	default:
+		break;
+	}
+
+	return -EINVAL;
+}
+
+// ============================================================ //
+// Sysfs power_supply subsystem
+// ============================================================ //
+
+static int get_end_threshold(u8 *out)
+{
+	u8 rdata;
+	int result;
+
+	result = ec_read_cached(conf.charge_control_address, &rdata);
+	if (result < 0)
+		return result;
+
+	rdata &= ~BIT(7); // last 7 bits contain the threshold
+
+	// the thresholds are unknown
+	if (rdata == 0)
+		return -ENODATA;
+
+	if (rdata < 10 || rdata > 100)
+		return -EINVAL;
+
+	*out = rdata;
+	return 0;
+}
+
+static int set_end_threshold(u8 value)
+{
+	int result;
+
+	if (value < 10 || value > 100)
+		return -EINVAL;
+
+	// compare with the EC rather than with a possibly stale pinned copy
+	mutex_lock(&ec_mutex);
+	__clear_bit(conf.charge_control_address, ec_cache_valid);
+	result = __ec_update_bits(conf.charge_control_address, 0xff,
+				  value | BIT(7));
+	mutex_unlock(&ec_mutex);
+
+	return result;
+}
+
+static ssize_t
+charge_control_start_threshold_show(struct device *device,
+				    struct device_attribute *attr, char *buf)
+{
+	int result;
+	u8 threshold;
+
+	result = get_end_threshold(&threshold);
+
+	if (result == -ENODATA)
+		return sysfs_emit(buf, "0\n");
+	else if (result < 0)
+		return result;
+
+	return sysfs_emit(buf, "%u\n", threshold - 10);
+}
+
+static ssize_t
+charge_control_start_threshold_store(struct device *dev,
+				     struct device_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int result;
+	u8 threshold;
+
+	result = kstrtou8(buf, 10, &threshold);
+	if (result < 0)
+		return result;
+
+	result = set_end_threshold(threshold + 10);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+static ssize_t charge_control_end_threshold_show(struct device *device,
+						 struct device_attribute *attr,
+						 char *buf)
+{
+	int result;
+	u8 threshold;
+
+	result = get_end_threshold(&threshold);
+
+	if (result == -ENODATA)
+		return sysfs_emit(buf, "0\n");
+	else if (result < 0)
+		return result;
+
+	return sysfs_emit(buf, "%u\n", threshold);
+}
+
+static ssize_t charge_control_end_threshold_store(struct device *dev,
+						  struct device_attribute *attr,
+						  const char *buf, size_t count)
+{
+	int result;
+	u8 threshold;
+
+	result = kstrtou8(buf, 10, &threshold);
+	if (result < 0)
+		return result;
+
+	result = set_end_threshold(threshold);
 	if (result < 0)
 		return result;
 
@@ -3670,23 +4322,59 @@ static ssize_t cooler_boost_store(struct device *dev,
 	return count;
 }
 
-static ssize_t available_shift_modes_show(struct device *device,
-				          struct device_attribute *attr,
-				          char *buf)
+/*
+ * Lookup tables of the shift and fan modes, built once the configuration
+ * is loaded: the index of the mode of every EC value (-1 if there is
+ * none) and the contents of the available_*_modes attributes.
+ */
+#define MODE_TABLE_AVAILABLE_SIZE 96
+
+struct mode_table {
+	s8 index[256];
+	char available[MODE_TABLE_AVAILABLE_SIZE];
+};
+
+static struct mode_table shift_mode_table;
+static struct mode_table fan_mode_table;
+
+static void mode_table_init(struct mode_table *table,
+			    const struct msi_ec_mode *modes)
 {
-	int result = 0;
-	int count = 0;
+	size_t len = 0;
+
+	memset(table->index, -1, sizeof(table->index));
+	table->available[0] = '\0';
 
-	for (int i = 0; conf.shift_mode.modes[i].name; i++) {
+	for (int i = 0; modes[i].name; i++) {
 		// NULL entries have NULL name
 
-		result = sysfs_emit_at(buf, count, "%s\n", conf.shift_mode.modes[i].name);
-		if (result < 0)
-			return result;
-		count += result;
+		// the first of the modes sharing a value wins, as before
+		if (table->index[modes[i].value] < 0)
+			table->index[modes[i].value] = i;
+
+		len += scnprintf(table->available + len,
+				 sizeof(table->available) - len,
+				 "%s\n", modes[i].name);
 	}
+}
 
-	return count;
+static void mode_tables_init(void)
+{
+	mode_table_init(&shift_mode_table, conf.shift_mode.modes);
+	mode_table_init(&fan_mode_table, conf.fan_mode.modes);
+}
+
+static const char *mode_table_name(const struct mode_table *table,
+				   const struct msi_ec_mode *modes, u8 value)
+{
+	return table->index[value] < 0 ? NULL : modes[table->index[value]].name;
+}
+
+static ssize_t available_shift_modes_show(struct device *device,
+				          struct device_attribute *attr,
+				          char *buf)
+{
+	return sysfs_emit(buf, "%s", shift_mode_table.available);
 }
 
 static ssize_t shift_mode_show(struct device *device,
@@ -3695,21 +4383,18 @@ static ssize_t shift_mode_show(struct device *device,
 {
 	u8 rdata;
 	int result;
+	const char *name;
 
-	result = ec_read(conf.shift_mode.address, &rdata);
+	result = ec_read_cached(conf.shift_mode.address, &rdata);
 	if (result < 0)
 		return result;
 
 	if (rdata == 0x80)
 		return sysfs_emit(buf, "%s\n", "unspecified");
 
-	for (int i = 0; conf.shift_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
-
-		if (rdata == conf.shift_mode.modes[i].value) {
-			return sysfs_emit(buf, "%s\n", conf.shift_mode.modes[i].name);
-		}
-	}
+	name = mode_table_name(&shift_mode_table, conf.shift_mode.modes, rdata);
+	if (name)
+		return sysfs_emit(buf, "%s\n", name);
 
 	return sysfs_emit(buf, "%s (%i)\n", "unknown", rdata);
 }
@@ -3719,21 +4404,18 @@ static ssize_t shift_mode_store(struct device *dev,
 				size_t count)
 {
 	int result;
+	int i;
 
-	for (int i = 0; conf.shift_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
-
-		if (sysfs_streq(conf.shift_mode.modes[i].name, buf)) {
-			result = ec_write(conf.shift_mode.address,
-					  conf.shift_mode.modes[i].value);
-			if (result < 0)
-				return result;
+	i = find_mode_by_name(conf.shift_mode.modes, buf);
+	if (i < 0)
+		return i;
 
-			return count;
-		}
-	}
+	result = ec_store_bits(conf.shift_mode.address, 0xff,
+				conf.shift_mode.modes[i].value);
+	if (result < 0)
+		return result;
 
-	return -EINVAL;
+	return count;
 }
 
 static ssize_t super_battery_show(struct device *device,
@@ -3779,19 +4461,7 @@ static ssize_t available_fan_modes_show(struct device *device,
 					struct device_attribute *attr,
 					char *buf)
 {
-	int result = 0;
-	int count = 0;
-
-	for (int i = 0; conf.fan_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
-
-		result = sysfs_emit_at(buf, count, "%s\n", conf.fan_mode.modes[i].name);
-		if (result < 0)
-			return result;
-		count += result;
-	}
-
-	return count;
+	return sysfs_emit(buf, "%s", fan_mode_table.available);
 }
 
 static ssize_t fan_mode_show(struct device *device,
@@ -3799,18 +4469,15 @@ static ssize_t fan_mode_show(struct device *device,
 {
 	u8 rdata;
 	int result;
+	const char *name;
 
-	result = ec_read(conf.fan_mode.address, &rdata);
+	result = ec_read_cached(conf.fan_mode.address, &rdata);
 	if (result < 0)
 		return result;
 
-	for (int i = 0; conf.fan_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
-
-		if (rdata == conf.fan_mode.modes[i].value) {
-			return sysfs_emit(buf, "%s\n", conf.fan_mode.modes[i].name);
-		}
-	}
+	name = mode_table_name(&fan_mode_table, conf.fan_mode.modes, rdata);
+	if (name)
+		return sysfs_emit(buf, "%s\n", name);
 
 	return sysfs_emit(buf, "%s (%i)\n", "unknown", rdata);
 }
@@ -3819,21 +4486,199 @@ static ssize_t fan_mode_store(struct device *dev, struct device_attribute *attr,
 			      const char *buf, size_t count)
 {
 	int result;
+	int i;
 
-	for (int i = 0; conf.fan_mode.modes[i].name; i++) {
-		// NULL entries have NULL name
+	i = find_mode_by_name(conf.fan_mode.modes, buf);
+	if (i < 0)
+		return i;
 
-		if (sysfs_streq(conf.fan_mode.modes[i].name, buf)) {
-			result = ec_write(conf.fan_mode.address,
-					  conf.fan_mode.modes[i].value);
-			if (result < 0)
-				return result;
+	result = ec_store_bits(conf.fan_mode.address, 0xff,
+				conf.fan_mode.modes[i].value);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+/*
+ * The in-kernel fan curve, evaluated on every sampler tick against the
+ * highest of the CPU and GPU temperatures. The EC doesn't expose a fan
+ * duty register, so each point selects one of the fan modes, or cooler
+ * boost. Lower points are only restored once the temperature has dropped
+ * FAN_CURVE_HYSTERESIS degrees below the active point.
+ */
+#define FAN_CURVE_MAX_POINTS 8
+#define FAN_CURVE_HYSTERESIS 3
+#define FAN_CURVE_BOOST      -1 // cooler boost instead of a fan mode
+#define FAN_CURVE_BOOST_NAME "boost"
+
+struct fan_curve_point {
+	u8 temp;
+	int mode; // index in conf.fan_mode.modes or FAN_CURVE_BOOST
+};
+
+static DEFINE_MUTEX(fan_curve_mutex);
+static struct fan_curve_point fan_curve[FAN_CURVE_MAX_POINTS];
+static int fan_curve_len = 0;
+static int fan_curve_active = -1; // index of the applied point
+static bool fan_curve_has_boost = false;
+
+static int fan_curve_apply(const struct fan_curve_point *point)
+{
+	struct ec_batch batch = {};
+	u8 boost_bit = BIT(conf.cooler_boost.bit);
+
+	ec_write_flush();
+
+	// either may be unset by a configuration override
+	if (point->mode == FAN_CURVE_BOOST) {
+		if (conf.cooler_boost.address == MSI_EC_ADDR_UNSUPP)
+			return -EOPNOTSUPP;
+
+		return ec_update_bits(conf.cooler_boost.address, boost_bit, boost_bit);
+	}
+
+	if (conf.fan_mode.address == MSI_EC_ADDR_UNSUPP)
+		return -EOPNOTSUPP;
+
+	ec_batch_add(&batch, conf.fan_mode.address, 0xff,
+		     conf.fan_mode.modes[point->mode].value);
+
+	// only take over cooler boost if the curve uses it
+	if (fan_curve_has_boost &&
+	    conf.cooler_boost.address != MSI_EC_ADDR_UNSUPP)
+		ec_batch_add(&batch, conf.cooler_boost.address, boost_bit, 0);
+
+	return ec_batch_commit(&batch);
+}
+
+static void fan_curve_update(u8 temp)
+{
+	int target = 0;
+
+	mutex_lock(&fan_curve_mutex);
+	if (fan_curve_len == 0)
+		goto unlock;
+
+	for (int i = 1; i < fan_curve_len; i++) {
+		if (temp >= fan_curve[i].temp)
+			target = i;
+	}
+
+	// hold the active point until the temperature drops enough
+	if (fan_curve_active > target &&
+	    temp + FAN_CURVE_HYSTERESIS > fan_curve[fan_curve_active].temp)
+		target = fan_curve_active;
+
+	if (target != fan_curve_active &&
+	    fan_curve_apply(&fan_curve[target]) == 0)
+		fan_curve_active = target;
+
+unlock:
+	mutex_unlock(&fan_curve_mutex);
+}
+
+// drops the curve, as its points refer to the previous configuration
+static void fan_curve_clear(void)
+{
+	mutex_lock(&fan_curve_mutex);
+	fan_curve_len = 0;
+	fan_curve_active = -1;
+	fan_curve_has_boost = false;
+	mutex_unlock(&fan_curve_mutex);
+}
+
+static ssize_t fan_curve_show(struct device *device,
+			      struct device_attribute *attr, char *buf)
+{
+	int count = 0;
+
+	mutex_lock(&fan_curve_mutex);
+	for (int i = 0; i < fan_curve_len; i++) {
+		const char *name = fan_curve[i].mode == FAN_CURVE_BOOST ?
+			FAN_CURVE_BOOST_NAME : conf.fan_mode.modes[fan_curve[i].mode].name;
+
+		count += sysfs_emit_at(buf, count, "%s%u:%s", i ? " " : "",
+				       fan_curve[i].temp, name);
+	}
+	mutex_unlock(&fan_curve_mutex);
+
+	count += sysfs_emit_at(buf, count, "\n");
+	return count;
+}
+
+/*
+ * fan_curve. Format: space or comma separated "temperature:mode" points
+ * with strictly increasing temperatures, where mode is an available fan
+ * mode or "boost". An empty string disables the curve.
+ */
+static ssize_t fan_curve_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct fan_curve_point points[FAN_CURVE_MAX_POINTS];
+	bool has_boost = false;
+	char *str, *cur, *token;
+	int len = 0;
+	int result = 0;
+
+	str = kstrndup(buf, count, GFP_KERNEL);
+	if (!str)
+		return -ENOMEM;
+
+	cur = str;
+	while (result == 0 && (token = strsep(&cur, " ,\n"))) {
+		char *mode;
+
+		if (!*token)
+			continue;
+
+		mode = strchr(token, ':');
+		if (!mode || len == FAN_CURVE_MAX_POINTS) {
+			result = -EINVAL;
+			break;
+		}
+		*mode++ = '\0';
+
+		result = kstrtou8(token, 10, &points[len].temp);
+		if (result < 0)
+			break;
+
+		if (len && points[len].temp <= points[len - 1].temp) {
+			result = -EINVAL;
+			break;
+		}
 
-			return count;
+		if (!strcmp(mode, FAN_CURVE_BOOST_NAME)) {
+			if (conf.cooler_boost.address == MSI_EC_ADDR_UNSUPP) {
+				result = -EOPNOTSUPP;
+				break;
+			}
+			points[len].mode = FAN_CURVE_BOOST;
+			has_boost = true;
+		} else {
+			result = find_mode_by_name(conf.fan_mode.modes, mode);
+			if (result < 0)
+				break;
+			points[len].mode = result;
+			result = 0;
 		}
+
+		len++;
 	}
+	kfree(str);
 
-	return -EINVAL;
+	if (result < 0)
+		return result;
+
+	mutex_lock(&fan_curve_mutex);
+	memcpy(fan_curve, points, len * sizeof(struct fan_curve_point));
+	fan_curve_len = len;
+	fan_curve_active = -1; // reapply on the next tick
+	fan_curve_has_boost = has_boost;
+	mutex_unlock(&fan_curve_mutex);
+
+	return count;
 }
 
 static ssize_t fw_version_show(struct device *device,
@@ -3852,17 +4697,25 @@ static ssize_t fw_version_show(struct device *device,
 static ssize_t fw_release_date_show(struct device *device,
 				    struct device_attribute *attr, char *buf)
 {
+	// the date is immediately followed by the time, read them at once
+	u8 rdata[MSI_EC_FW_DATE_LENGTH + MSI_EC_FW_TIME_LENGTH];
 	u8 rdate[MSI_EC_FW_DATE_LENGTH + 1];
 	u8 rtime[MSI_EC_FW_TIME_LENGTH + 1];
 	int result;
 	struct rtc_time time;
 
-	memset(rdate, 0, sizeof(rdate));
-	result = ec_read_seq(MSI_EC_FW_DATE_ADDRESS, rdate,
-			     MSI_EC_FW_DATE_LENGTH);
+	BUILD_BUG_ON(MSI_EC_FW_DATE_ADDRESS + MSI_EC_FW_DATE_LENGTH !=
+		     MSI_EC_FW_TIME_ADDRESS);
+
+	result = ec_read_seq(MSI_EC_FW_DATE_ADDRESS, rdata, sizeof(rdata));
 	if (result < 0)
 		return result;
 
+	memset(rdate, 0, sizeof(rdate));
+	memcpy(rdate, rdata, MSI_EC_FW_DATE_LENGTH);
+	memset(rtime, 0, sizeof(rtime));
+	memcpy(rtime, rdata + MSI_EC_FW_DATE_LENGTH, MSI_EC_FW_TIME_LENGTH);
+
 	result = sscanf(rdate, "%02d%02d%04d", &time.tm_mon, &time.tm_mday, &time.tm_year);
 	if (result != 3)
 		return -ENODATA;
@@ -3871,12 +4724,6 @@ static ssize_t fw_release_date_show(struct device *device,
 	time.tm_mon -= 1;
 	time.tm_year -= 1900;
 
-	memset(rtime, 0, sizeof(rtime));
-	result = ec_read_seq(MSI_EC_FW_TIME_ADDRESS, rtime,
-			     MSI_EC_FW_TIME_LENGTH);
-	if (result < 0)
-		return result;
-
 	result = sscanf(rtime, "%02d:%02d:%02d", &time.tm_hour, &time.tm_min, &time.tm_sec);
 	if (result != 3)
 		return -ENODATA;
@@ -3884,6 +4731,181 @@ static ssize_t fw_release_date_show(struct device *device,
 	return sysfs_emit(buf, "%ptR\n", &time);
 }
 
+static int profile_add_pair(struct ec_batch *batch,
+			    const char *key, const char *value)
+{
+	int result;
+	bool enabled;
+	u8 threshold;
+	int i;
+
+	if (!strcmp(key, "shift_mode")) {
+		if (conf.shift_mode.address == MSI_EC_ADDR_UNSUPP)
+			return -EOPNOTSUPP;
+
+		i = find_mode_by_name(conf.shift_mode.modes, value);
+		if (i < 0)
+			return i;
+
+		return ec_batch_add(batch, conf.shift_mode.address, 0xff,
+				    conf.shift_mode.modes[i].value);
+	}
+
+	if (!strcmp(key, "fan_mode")) {
+		if (conf.fan_mode.address == MSI_EC_ADDR_UNSUPP)
+			return -EOPNOTSUPP;
+
+		i = find_mode_by_name(conf.fan_mode.modes, value);
+		if (i < 0)
+			return i;
+
+		return ec_batch_add(batch, conf.fan_mode.address, 0xff,
+				    conf.fan_mode.modes[i].value);
+	}
+
+	if (!strcmp(key, "cooler_boost")) {
+		if (conf.cooler_boost.address == MSI_EC_ADDR_UNSUPP)
+			return -EOPNOTSUPP;
+
+		result = kstrtobool(value, &enabled);
+		if (result)
+			return result;
+
+		return ec_batch_add(batch, conf.cooler_boost.address,
+				    BIT(conf.cooler_boost.bit),
+				    enabled ? BIT(conf.cooler_boost.bit) : 0);
+	}
+
+	if (!strcmp(key, "super_battery")) {
+		if (conf.super_battery.address == MSI_EC_ADDR_UNSUPP)
+			return -EOPNOTSUPP;
+
+		result = kstrtobool(value, &enabled);
+		if (result)
+			return result;
+
+		return ec_batch_add(batch, conf.super_battery.address,
+				    conf.super_battery.mask,
+				    enabled ? conf.super_battery.mask : 0);
+	}
+
+	if (!strcmp(key, "charge_control_end_threshold")) {
+		if (!charge_control_supported)
+			return -EOPNOTSUPP;
+
+		result = kstrtou8(value, 10, &threshold);
+		if (result < 0)
+			return result;
+
+		if (threshold < 10 || threshold > 100)
+			return -EINVAL;
+
+		return ec_batch_add(batch, conf.charge_control_address, 0xff,
+				    threshold | BIT(7));
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * profile. applies several settings at once. Format: space, comma or newline
+ * separated "key=value" pairs, where keys are the names of the attributes.
+ * All pairs are validated before anything is written; if writing fails
+ * partway, the settings already written are restored.
+ */
+static ssize_t profile_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct ec_batch batch = {};
+	char *str, *cur, *token;
+	int result = 0;
+
+	str = kstrndup(buf, count, GFP_KERNEL);
+	if (!str)
+		return -ENOMEM;
+
+	cur = str;
+	while (result == 0 && (token = strsep(&cur, " ,\n"))) {
+		char *value;
+
+		if (!*token)
+			continue;
+
+		value = strchr(token, '=');
+		if (!value) {
+			result = -EINVAL;
+			break;
+		}
+		*value++ = '\0';
+
+		result = profile_add_pair(&batch, token, value);
+	}
+	kfree(str);
+
+	if (result < 0)
+		return result;
+
+	ec_write_flush();
+	result = ec_batch_commit(&batch);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+// reading the status clears the reported error
+static ssize_t write_status_show(struct device *device,
+				 struct device_attribute *attr, char *buf)
+{
+	unsigned int queued;
+	int error;
+
+	spin_lock(&ec_write_lock);
+	queued = ec_write_queued;
+	error = ec_write_error;
+	ec_write_error = 0;
+	spin_unlock(&ec_write_lock);
+
+	if (error)
+		return sysfs_emit(buf, "error %d\n", error);
+
+	if (queued)
+		return sysfs_emit(buf, "%s\n", "pending");
+
+	return sysfs_emit(buf, "%s\n", "ok");
+}
+
+static ssize_t stats_show(struct device *device,
+			  struct device_attribute *attr, char *buf)
+{
+	struct ec_counters total = {};
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		const struct ec_counters *counters = per_cpu_ptr(&ec_counters, cpu);
+
+		total.reads += READ_ONCE(counters->reads);
+		total.writes += READ_ONCE(counters->writes);
+		total.errors += READ_ONCE(counters->errors);
+		total.timeouts += READ_ONCE(counters->timeouts);
+		total.busy += READ_ONCE(counters->busy);
+		total.cache_hits += READ_ONCE(counters->cache_hits);
+		total.coalesced += READ_ONCE(counters->coalesced);
+	}
+
+	return sysfs_emit(buf,
+			  "reads %lu\n"
+			  "writes %lu\n"
+			  "errors %lu\n"
+			  "timeouts %lu\n"
+			  "busy %lu\n"
+			  "cache_hits %lu\n"
+			  "coalesced %lu\n",
+			  total.reads, total.writes, total.errors,
+			  total.timeouts, total.busy, total.cache_hits,
+			  total.coalesced);
+}
+
 static DEVICE_ATTR_RW(webcam);
 static DEVICE_ATTR_RW(webcam_block);
 static DEVICE_ATTR_RW(fn_key);
@@ -3894,8 +4916,12 @@ static DEVICE_ATTR_RW(shift_mode);
 static DEVICE_ATTR_RW(super_battery);
 static DEVICE_ATTR_RO(available_fan_modes);
 static DEVICE_ATTR_RW(fan_mode);
+static DEVICE_ATTR_RW(fan_curve);
 static DEVICE_ATTR_RO(fw_version);
 static DEVICE_ATTR_RO(fw_release_date);
+static DEVICE_ATTR_WO(profile);
+static DEVICE_ATTR_RO(write_status);
+static DEVICE_ATTR_RO(stats);
 
 static struct attribute *msi_root_attrs[] = {
 	&dev_attr_webcam.attr,
@@ -3908,11 +4934,221 @@ static struct attribute *msi_root_attrs[] = {
 	&dev_attr_super_battery.attr,
 	&dev_attr_available_fan_modes.attr,
 	&dev_attr_fan_mode.attr,
+	&dev_attr_fan_curve.attr,
 	&dev_attr_fw_version.attr,
 	&dev_attr_fw_release_date.attr,
+	&dev_attr_profile.attr,
+	&dev_attr_write_status.attr,
+	&dev_attr_stats.attr,
 	NULL
 };
 
+// ============================================================ //
+// Temperature statistics
+// ============================================================ //
+
+/*
+ * Running aggregates of the temperatures read by the sampler. The moving
+ * average is kept in fixed point with TEMP_EMA_SHIFT fractional bits.
+ * With temp_stats_reset_on_read, reading the minimum, the maximum or the
+ * sample count restarts it from the last sample; the average is never
+ * reset.
+ */
+#define TEMP_EMA_SHIFT 8
+
+enum temp_stat {
+	TEMP_STAT_AVERAGE,
+	TEMP_STAT_MIN,
+	TEMP_STAT_MAX,
+	TEMP_STAT_SAMPLES,
+};
+
+struct temp_stats {
+	bool valid; // set by the first sample
+	u32 ema;
+	u8 last;
+	u8 min;
+	u8 max;
+	u64 count;
+};
+
+static DEFINE_MUTEX(temp_stats_mutex);
+static struct temp_stats cpu_temp_stats;
+static struct temp_stats gpu_temp_stats;
+
+static void temp_stats_update(struct temp_stats *stats, u8 temp)
+{
+	s32 sample = (u32)temp << TEMP_EMA_SHIFT;
+	s32 ema;
+	unsigned int alpha = clamp_val(READ_ONCE(temp_ema_alpha), 1, 100);
+
+	mutex_lock(&temp_stats_mutex);
+	if (!stats->valid) {
+		stats->valid = true;
+		stats->ema = sample;
+		stats->min = temp;
+		stats->max = temp;
+	} else {
+		ema = stats->ema;
+		stats->ema = ema + (sample - ema) * (s32)alpha / 100;
+		stats->min = min(stats->min, temp);
+		stats->max = max(stats->max, temp);
+	}
+	stats->last = temp;
+	stats->count++;
+	mutex_unlock(&temp_stats_mutex);
+}
+
+// prints a single statistic, the average has one decimal digit
+static ssize_t temp_stats_show_common(struct temp_stats *stats,
+				      enum temp_stat stat, char *buf)
+{
+	bool reset = READ_ONCE(temp_stats_reset_on_read);
+	u64 value;
+	u32 ema_x10;
+
+	mutex_lock(&temp_stats_mutex);
+	switch (stat) {
+	case TEMP_STAT_AVERAGE:
+		value = stats->ema;
+		break;
+	case TEMP_STAT_MIN:
+		value = stats->min;
+		if (reset)
+			stats->min = stats->last;
+		break;
+	case TEMP_STAT_MAX:
+		value = stats->max;
+		if (reset)
+			stats->max = stats->last;
+		break;
+	default:
+		value = stats->count;
+		if (reset)
+			stats->count = 0;
+		break;
+	}
+	mutex_unlock(&temp_stats_mutex);
+
+	if (stat != TEMP_STAT_AVERAGE)
+		return sysfs_emit(buf, "%llu\n", value);
+
+	// round to the nearest tenth
+	ema_x10 = (value * 10 + BIT(TEMP_EMA_SHIFT - 1)) >> TEMP_EMA_SHIFT;
+
+	return sysfs_emit(buf, "%u.%u\n", ema_x10 / 10, ema_x10 % 10);
+}
+
+// ============================================================ //
+// Temperature alarms
+// ============================================================ //
+
+/*
+ * Thresholds compared against the temperatures read by the sampler. An
+ * alarm is raised when a threshold is reached and cleared once the
+ * temperature goes TEMP_ALARM_HYSTERESIS degrees back past it. Only the
+ * transitions are reported, so steady state costs nothing. A threshold
+ * of 0 disables the alarm.
+ */
+#define TEMP_ALARM_HYSTERESIS 3
+
+enum temp_alarm_state {
+	TEMP_ALARM_NORMAL,
+	TEMP_ALARM_HIGH,
+	TEMP_ALARM_LOW,
+};
+
+static const char *const temp_alarm_names[] = {
+	[TEMP_ALARM_NORMAL] = "normal",
+	[TEMP_ALARM_HIGH]   = "high",
+	[TEMP_ALARM_LOW]    = "low",
+};
+
+struct temp_alarm {
+	u8 high;
+	u8 low;
+	enum temp_alarm_state state;
+};
+
+static DEFINE_MUTEX(temp_alarm_mutex);
+static struct temp_alarm cpu_temp_alarm;
+static struct temp_alarm gpu_temp_alarm;
+
+static enum temp_alarm_state temp_alarm_eval(const struct temp_alarm *alarm,
+					      u8 temp)
+{
+	if (alarm->high && temp >= alarm->high)
+		return TEMP_ALARM_HIGH;
+
+	if (alarm->low && temp <= alarm->low)
+		return TEMP_ALARM_LOW;
+
+	if (alarm->state == TEMP_ALARM_HIGH && alarm->high &&
+	    temp + TEMP_ALARM_HYSTERESIS > alarm->high)
+		return TEMP_ALARM_HIGH;
+
+	if (alarm->state == TEMP_ALARM_LOW && alarm->low &&
+	    temp < alarm->low + TEMP_ALARM_HYSTERESIS)
+		return TEMP_ALARM_LOW;
+
+	return TEMP_ALARM_NORMAL;
+}
+
+// notifies the temperature_alarm attribute of the group on transitions
+static void temp_alarm_update(struct temp_alarm *alarm, const char *group,
+			      u8 temp)
+{
+	struct kobject *kobj = &msi_platform_device->dev.kobj;
+	enum temp_alarm_state state;
+	bool changed;
+
+	mutex_lock(&temp_alarm_mutex);
+	state = temp_alarm_eval(alarm, temp);
+	changed = state != alarm->state;
+	alarm->state = state;
+	mutex_unlock(&temp_alarm_mutex);
+
+	if (changed) {
+		char env_attr[48], env_alarm[32];
+		char *envp[] = { env_attr, env_alarm, NULL };
+
+		sysfs_notify(kobj, group, "temperature_alarm");
+
+		snprintf(env_attr, sizeof(env_attr),
+			 "MSI_EC_ATTR=%s/temperature_alarm", group);
+		snprintf(env_alarm, sizeof(env_alarm),
+			 "MSI_EC_ALARM=%s", temp_alarm_names[state]);
+		kobject_uevent_env(kobj, KOBJ_CHANGE, envp);
+	}
+}
+
+static ssize_t temp_alarm_threshold_show(u8 *threshold, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", READ_ONCE(*threshold));
+}
+
+static ssize_t temp_alarm_threshold_store(u8 *threshold,
+					  const char *buf, size_t count)
+{
+	int result;
+	u8 value;
+
+	result = kstrtou8(buf, 10, &value);
+	if (result < 0)
+		return result;
+
+	mutex_lock(&temp_alarm_mutex);
+	*threshold = value;
+	mutex_unlock(&temp_alarm_mutex);
+
+	return count;
+}
+
+static ssize_t temp_alarm_state_show(struct temp_alarm *alarm, char *buf)
+{
+	return sysfs_emit(buf, "%s\n", temp_alarm_names[READ_ONCE(alarm->state)]);
+}
+
 // ============================================================ //
 // Sysfs platform device attributes (cpu)
 // ============================================================ //
@@ -3924,7 +5160,7 @@ static ssize_t cpu_realtime_temperature_show(struct device *device,
 	u8 rdata;
 	int result;
 
-	result = ec_read(conf.cpu.rt_temp_address, &rdata);
+	result = ec_read_cached(conf.cpu.rt_temp_address, &rdata);
 	if (result < 0)
 		return result;
 
@@ -3938,19 +5174,82 @@ static ssize_t cpu_realtime_fan_speed_show(struct device *device,
 	u8 rdata;
 	int result;
 
-	result = ec_read(conf.cpu.rt_fan_speed_address, &rdata);
+	result = ec_read_cached(conf.cpu.rt_fan_speed_address, &rdata);
 	if (result < 0)
 		return result;
 
 	return sysfs_emit(buf, "%i\n", rdata);
 }
 
-static struct device_attribute dev_attr_cpu_realtime_temperature = {
-	.attr = {
-		.name = "realtime_temperature",
-		.mode = 0444,
-	},
-	.show = cpu_realtime_temperature_show,
+static ssize_t cpu_temperature_average_show(struct device *device,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	return temp_stats_show_common(&cpu_temp_stats, TEMP_STAT_AVERAGE, buf);
+}
+
+static ssize_t cpu_temperature_min_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return temp_stats_show_common(&cpu_temp_stats, TEMP_STAT_MIN, buf);
+}
+
+static ssize_t cpu_temperature_max_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return temp_stats_show_common(&cpu_temp_stats, TEMP_STAT_MAX, buf);
+}
+
+static ssize_t cpu_temperature_samples_show(struct device *device,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	return temp_stats_show_common(&cpu_temp_stats, TEMP_STAT_SAMPLES, buf);
+}
+
+static ssize_t cpu_temperature_high_show(struct device *device,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	return temp_alarm_threshold_show(&cpu_temp_alarm.high, buf);
+}
+
+static ssize_t cpu_temperature_high_store(struct device *dev,
+					   struct device_attribute *attr,
+					   const char *buf, size_t count)
+{
+	return temp_alarm_threshold_store(&cpu_temp_alarm.high, buf, count);
+}
+
+static ssize_t cpu_temperature_low_show(struct device *device,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	return temp_alarm_threshold_show(&cpu_temp_alarm.low, buf);
+}
+
+static ssize_t cpu_temperature_low_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	return temp_alarm_threshold_store(&cpu_temp_alarm.low, buf, count);
+}
+
+static ssize_t cpu_temperature_alarm_show(struct device *device,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	return temp_alarm_state_show(&cpu_temp_alarm, buf);
+}
+
+static struct device_attribute dev_attr_cpu_realtime_temperature = {
+	.attr = {
+		.name = "realtime_temperature",
+		.mode = 0444,
+	},
+	.show = cpu_realtime_temperature_show,
 };
 
 static struct device_attribute dev_attr_cpu_realtime_fan_speed = {
@@ -3961,9 +5260,74 @@ static struct device_attribute dev_attr_cpu_realtime_fan_speed = {
 	.show = cpu_realtime_fan_speed_show,
 };
 
+static struct device_attribute dev_attr_cpu_temperature_average = {
+	.attr = {
+		.name = "temperature_average",
+		.mode = 0444,
+	},
+	.show = cpu_temperature_average_show,
+};
+
+static struct device_attribute dev_attr_cpu_temperature_min = {
+	.attr = {
+		.name = "temperature_min",
+		.mode = 0444,
+	},
+	.show = cpu_temperature_min_show,
+};
+
+static struct device_attribute dev_attr_cpu_temperature_max = {
+	.attr = {
+		.name = "temperature_max",
+		.mode = 0444,
+	},
+	.show = cpu_temperature_max_show,
+};
+
+static struct device_attribute dev_attr_cpu_temperature_samples = {
+	.attr = {
+		.name = "temperature_samples",
+		.mode = 0444,
+	},
+	.show = cpu_temperature_samples_show,
+};
+
+static struct device_attribute dev_attr_cpu_temperature_high = {
+	.attr = {
+		.name = "temperature_high",
+		.mode = 0644,
+	},
+	.show = cpu_temperature_high_show,
+	.store = cpu_temperature_high_store,
+};
+
+static struct device_attribute dev_attr_cpu_temperature_low = {
+	.attr = {
+		.name = "temperature_low",
+		.mode = 0644,
+	},
+	.show = cpu_temperature_low_show,
+	.store = cpu_temperature_low_store,
+};
+
+static struct device_attribute dev_attr_cpu_temperature_alarm = {
+	.attr = {
+		.name = "temperature_alarm",
+		.mode = 0444,
+	},
+	.show = cpu_temperature_alarm_show,
+};
+
 static struct attribute *msi_cpu_attrs[] = {
 	&dev_attr_cpu_realtime_temperature.attr,
 	&dev_attr_cpu_realtime_fan_speed.attr,
+	&dev_attr_cpu_temperature_average.attr,
+	&dev_attr_cpu_temperature_min.attr,
+	&dev_attr_cpu_temperature_max.attr,
+	&dev_attr_cpu_temperature_samples.attr,
+	&dev_attr_cpu_temperature_high.attr,
+	&dev_attr_cpu_temperature_low.attr,
+	&dev_attr_cpu_temperature_alarm.attr,
 	NULL
 };
 
@@ -3978,7 +5342,7 @@ static ssize_t gpu_realtime_temperature_show(struct device *device,
 	u8 rdata;
 	int result;
 
-	result = ec_read(conf.gpu.rt_temp_address, &rdata);
+	result = ec_read_cached(conf.gpu.rt_temp_address, &rdata);
 	if (result < 0)
 		return result;
 
@@ -3992,13 +5356,76 @@ static ssize_t gpu_realtime_fan_speed_show(struct device *device,
 	u8 rdata;
 	int result;
 
-	result = ec_read(conf.gpu.rt_fan_speed_address, &rdata);
+	result = ec_read_cached(conf.gpu.rt_fan_speed_address, &rdata);
 	if (result < 0)
 		return result;
 
 	return sysfs_emit(buf, "%i\n", rdata);
 }
 
+static ssize_t gpu_temperature_average_show(struct device *device,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	return temp_stats_show_common(&gpu_temp_stats, TEMP_STAT_AVERAGE, buf);
+}
+
+static ssize_t gpu_temperature_min_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return temp_stats_show_common(&gpu_temp_stats, TEMP_STAT_MIN, buf);
+}
+
+static ssize_t gpu_temperature_max_show(struct device *device,
+					struct device_attribute *attr,
+					char *buf)
+{
+	return temp_stats_show_common(&gpu_temp_stats, TEMP_STAT_MAX, buf);
+}
+
+static ssize_t gpu_temperature_samples_show(struct device *device,
+					    struct device_attribute *attr,
+					    char *buf)
+{
+	return temp_stats_show_common(&gpu_temp_stats, TEMP_STAT_SAMPLES, buf);
+}
+
+static ssize_t gpu_temperature_high_show(struct device *device,
+					  struct device_attribute *attr,
+					  char *buf)
+{
+	return temp_alarm_threshold_show(&gpu_temp_alarm.high, buf);
+}
+
+static ssize_t gpu_temperature_high_store(struct device *dev,
+					   struct device_attribute *attr,
+					   const char *buf, size_t count)
+{
+	return temp_alarm_threshold_store(&gpu_temp_alarm.high, buf, count);
+}
+
+static ssize_t gpu_temperature_low_show(struct device *device,
+					 struct device_attribute *attr,
+					 char *buf)
+{
+	return temp_alarm_threshold_show(&gpu_temp_alarm.low, buf);
+}
+
+static ssize_t gpu_temperature_low_store(struct device *dev,
+					  struct device_attribute *attr,
+					  const char *buf, size_t count)
+{
+	return temp_alarm_threshold_store(&gpu_temp_alarm.low, buf, count);
+}
+
+static ssize_t gpu_temperature_alarm_show(struct device *device,
+					   struct device_attribute *attr,
+					   char *buf)
+{
+	return temp_alarm_state_show(&gpu_temp_alarm, buf);
+}
+
 static struct device_attribute dev_attr_gpu_realtime_temperature = {
 	.attr = {
 		.name = "realtime_temperature",
@@ -4015,9 +5442,74 @@ static struct device_attribute dev_attr_gpu_realtime_fan_speed = {
 	.show = gpu_realtime_fan_speed_show,
 };
 
+static struct device_attribute dev_attr_gpu_temperature_average = {
+	.attr = {
+		.name = "temperature_average",
+		.mode = 0444,
+	},
+	.show = gpu_temperature_average_show,
+};
+
+static struct device_attribute dev_attr_gpu_temperature_min = {
+	.attr = {
+		.name = "temperature_min",
+		.mode = 0444,
+	},
+	.show = gpu_temperature_min_show,
+};
+
+static struct device_attribute dev_attr_gpu_temperature_max = {
+	.attr = {
+		.name = "temperature_max",
+		.mode = 0444,
+	},
+	.show = gpu_temperature_max_show,
+};
+
+static struct device_attribute dev_attr_gpu_temperature_samples = {
+	.attr = {
+		.name = "temperature_samples",
+		.mode = 0444,
+	},
+	.show = gpu_temperature_samples_show,
+};
+
+static struct device_attribute dev_attr_gpu_temperature_high = {
+	.attr = {
+		.name = "temperature_high",
+		.mode = 0644,
+	},
+	.show = gpu_temperature_high_show,
+	.store = gpu_temperature_high_store,
+};
+
+static struct device_attribute dev_attr_gpu_temperature_low = {
+	.attr = {
+		.name = "temperature_low",
+		.mode = 0644,
+	},
+	.show = gpu_temperature_low_show,
+	.store = gpu_temperature_low_store,
+};
+
+static struct device_attribute dev_attr_gpu_temperature_alarm = {
+	.attr = {
+		.name = "temperature_alarm",
+		.mode = 0444,
+	},
+	.show = gpu_temperature_alarm_show,
+};
+
 static struct attribute *msi_gpu_attrs[] = {
 	&dev_attr_gpu_realtime_temperature.attr,
 	&dev_attr_gpu_realtime_fan_speed.attr,
+	&dev_attr_gpu_temperature_average.attr,
+	&dev_attr_gpu_temperature_min.attr,
+	&dev_attr_gpu_temperature_max.attr,
+	&dev_attr_gpu_temperature_samples.attr,
+	&dev_attr_gpu_temperature_high.attr,
+	&dev_attr_gpu_temperature_low.attr,
+	&dev_attr_gpu_temperature_alarm.attr,
 	NULL
 };
 
@@ -4025,10 +5517,109 @@ static struct attribute *msi_gpu_attrs[] = {
 // Sysfs platform device attributes (debug)
 // ============================================================ //
 
+/*
+ * Sets of EC addresses selected by the user, written and shown as lists of
+ * hexadecimal addresses and inclusive ranges, e.g. "68-90,c0-cf".
+ */
+static int parse_address_ranges(const char *buf, size_t count,
+				unsigned long *selected)
+{
+	char *str, *cur, *token;
+	int result = 0;
+
+	if (sysfs_streq(buf, "all")) {
+		bitmap_fill(selected, MSI_EC_RAM_SIZE);
+		return 0;
+	}
+
+	str = kstrndup(buf, count, GFP_KERNEL);
+	if (!str)
+		return -ENOMEM;
+
+	bitmap_zero(selected, MSI_EC_RAM_SIZE);
+	cur = str;
+	while (result == 0 && (token = strsep(&cur, " ,\n"))) {
+		char *last_s;
+		u8 first, last;
+
+		if (!*token)
+			continue;
+
+		last_s = strchr(token, '-');
+		if (last_s)
+			*last_s++ = '\0';
+
+		result = kstrtou8(token, 16, &first);
+		if (result == 0)
+			result = last_s ? kstrtou8(last_s, 16, &last) : 0;
+		if (result == 0 && !last_s)
+			last = first;
+		if (result == 0 && last < first)
+			result = -EINVAL;
+		if (result == 0)
+			bitmap_set(selected, first, last - first + 1);
+	}
+	kfree(str);
+
+	if (result == 0 && bitmap_empty(selected, MSI_EC_RAM_SIZE))
+		result = -EINVAL;
+
+	return result;
+}
+
+static int emit_address_ranges(const unsigned long *selected, char *buf)
+{
+	unsigned int start, end;
+	int count = 0;
+
+	start = find_next_bit(selected, MSI_EC_RAM_SIZE, 0);
+	while (start < MSI_EC_RAM_SIZE) {
+		end = find_next_zero_bit(selected, MSI_EC_RAM_SIZE, start);
+
+		count += sysfs_emit_at(buf, count, "%s%02x", count ? "," : "",
+				       start);
+		if (end - start > 1)
+			count += sysfs_emit_at(buf, count, "-%02x", end - 1);
+
+		start = find_next_bit(selected, MSI_EC_RAM_SIZE, end);
+	}
+
+	return count;
+}
+
+// reads the selected addresses, one EC pass per contiguous range
+static int ec_read_ranges(const unsigned long *selected, u8 *rdata)
+{
+	unsigned int start, end;
+	int result;
+
+	start = find_next_bit(selected, MSI_EC_RAM_SIZE, 0);
+	while (start < MSI_EC_RAM_SIZE) {
+		end = find_next_zero_bit(selected, MSI_EC_RAM_SIZE, start);
+
+		result = ec_read_seq(start, rdata + start, end - start);
+		if (result < 0)
+			return result;
+
+		start = find_next_bit(selected, MSI_EC_RAM_SIZE, end);
+	}
+
+	return 0;
+}
+
+/*
+ * ec_dump only reads the addresses selected with ec_dump_ranges. In delta
+ * mode it prints the addresses whose value differs from the previous dump
+ * instead of the table. Every dump updates the reference values.
+ */
+static DEFINE_MUTEX(ec_dump_mutex);
+static DECLARE_BITMAP(ec_dump_selected, MSI_EC_RAM_SIZE); // filled on probe
+static DECLARE_BITMAP(ec_dump_known, MSI_EC_RAM_SIZE); // ec_dump_prev is valid
+static u8 ec_dump_prev[MSI_EC_RAM_SIZE];
+static bool ec_dump_delta_mode;
+
 // Prints an EC memory dump in form of a table
-static ssize_t ec_dump_show(struct device *device,
-			    struct device_attribute *attr,
-			    char *buf)
+static int ec_dump_table(const u8 *rdata, char *buf)
 {
 	int count = 0;
 	char ascii_row[16]; // not null-terminated
@@ -4039,19 +5630,26 @@ static ssize_t ec_dump_show(struct device *device,
 		"|      | _0 _1 _2 _3 _4 _5 _6 _7 _8 _9 _a _b _c _d _e _f\n"
 		"|------+------------------------------------------------\n");
 
-	// print dump
+	// print dump, skipping the rows without selected addresses
 	for (u8 i = 0x0; i <= 0xf; i++) {
 		u8 addr_base = i * 16;
 
+		if (find_next_bit(ec_dump_selected, addr_base + 16, addr_base) >=
+		    addr_base + 16)
+			continue;
+
 		count += sysfs_emit_at(buf, count, "| %#x_ |", i);
 		for (u8 j = 0x0; j <= 0xf; j++) {
-			u8 rdata;
-			int result = ec_read(addr_base + j, &rdata);
-			if (result < 0)
-				return result;
+			u8 value = rdata[addr_base + j];
 
-			count += sysfs_emit_at(buf, count, " %02x", rdata);
-			ascii_row[j] = isascii(rdata) && isgraph(rdata) ? rdata : '.';
+			if (!test_bit(addr_base + j, ec_dump_selected)) {
+				count += sysfs_emit_at(buf, count, " --");
+				ascii_row[j] = ' ';
+				continue;
+			}
+
+			count += sysfs_emit_at(buf, count, " %02x", value);
+			ascii_row[j] = isascii(value) && isgraph(value) ? value : '.';
 		}
 
 		count += sysfs_emit_at(buf, count, "  |%.16s|\n", ascii_row);
@@ -4060,6 +5658,114 @@ static ssize_t ec_dump_show(struct device *device,
 	return count;
 }
 
+// prints "address old new" for every selected byte changed since the previous dump
+static int ec_dump_changes(const u8 *rdata, char *buf)
+{
+	unsigned int addr;
+	int count = 0;
+
+	for_each_set_bit(addr, ec_dump_selected, MSI_EC_RAM_SIZE) {
+		if (!test_bit(addr, ec_dump_known) ||
+		    ec_dump_prev[addr] == rdata[addr])
+			continue;
+
+		count += sysfs_emit_at(buf, count, "%02x %02x %02x\n", addr,
+				       ec_dump_prev[addr], rdata[addr]);
+	}
+
+	return count;
+}
+
+static ssize_t ec_dump_show(struct device *device,
+			    struct device_attribute *attr,
+			    char *buf)
+{
+	unsigned int addr;
+	int count;
+	int result;
+	u8 rdata[MSI_EC_RAM_SIZE];
+
+	mutex_lock(&ec_dump_mutex);
+
+	result = ec_read_ranges(ec_dump_selected, rdata);
+	if (result < 0)
+		goto out;
+
+	if (ec_dump_delta_mode)
+		count = ec_dump_changes(rdata, buf);
+	else
+		count = ec_dump_table(rdata, buf);
+
+	for_each_set_bit(addr, ec_dump_selected, MSI_EC_RAM_SIZE)
+		ec_dump_prev[addr] = rdata[addr];
+	bitmap_or(ec_dump_known, ec_dump_known, ec_dump_selected,
+		  MSI_EC_RAM_SIZE);
+	result = count;
+
+out:
+	mutex_unlock(&ec_dump_mutex);
+
+	return result;
+}
+
+// ec_dump_ranges. selects the dumped addresses. Format: "xx-xx,xx", xx - hex u8
+static ssize_t ec_dump_ranges_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	DECLARE_BITMAP(selected, MSI_EC_RAM_SIZE);
+	int result;
+
+	result = parse_address_ranges(buf, count, selected);
+	if (result < 0)
+		return result;
+
+	mutex_lock(&ec_dump_mutex);
+	bitmap_copy(ec_dump_selected, selected, MSI_EC_RAM_SIZE);
+	mutex_unlock(&ec_dump_mutex);
+
+	return count;
+}
+
+static ssize_t ec_dump_ranges_show(struct device *device,
+				   struct device_attribute *attr,
+				   char *buf)
+{
+	int count;
+
+	mutex_lock(&ec_dump_mutex);
+	count = emit_address_ranges(ec_dump_selected, buf);
+	mutex_unlock(&ec_dump_mutex);
+
+	count += sysfs_emit_at(buf, count, "\n");
+
+	return count;
+}
+
+// ec_dump_delta. switches ec_dump between the table and the changed bytes
+static ssize_t ec_dump_delta_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	bool value;
+	int result;
+
+	result = kstrtobool(buf, &value);
+	if (result < 0)
+		return result;
+
+	WRITE_ONCE(ec_dump_delta_mode, value);
+
+	return count;
+}
+
+static ssize_t ec_dump_delta_show(struct device *device,
+				  struct device_attribute *attr,
+				  char *buf)
+{
+	return sysfs_emit(buf, "%s\n", str_on_off(READ_ONCE(ec_dump_delta_mode)));
+}
+
 // stores a value in the specified EC memory address. Format: "xx=xx", xx - hex u8
 static ssize_t ec_set_store(struct device *dev, struct device_attribute *attr,
 			    const char *buf, size_t count)
@@ -4087,7 +5793,8 @@ static ssize_t ec_set_store(struct device *dev, struct device_attribute *attr,
 		return result;
 
 	// write val to EC[addr]
-	result = ec_write(addr, val);
+	ec_write_flush();
+	result = ec_write_cached(addr, val);
 	if (result < 0)
 		return result;
 
@@ -4127,7 +5834,7 @@ static ssize_t ec_get_show(struct device *device,
 	u8 rdata;
 	int result;
 
-	result = ec_read(ec_get_addr, &rdata);
+	result = ec_read_raw(ec_get_addr, &rdata);
 	if (result < 0)
 		return result;
 
@@ -4135,15 +5842,447 @@ static ssize_t ec_get_show(struct device *device,
 	return sysfs_emit(buf, "%02x\n", rdata);
 };
 
-static DEVICE_ATTR_RO(ec_dump);
-static DEVICE_ATTR_WO(ec_set);
-static DEVICE_ATTR_RW(ec_get);
+// ec_ram. raw EC memory, supports reads and writes at arbitrary offsets
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0))
+static ssize_t ec_ram_read(struct file *filp, struct kobject *kobj,
+			   const struct bin_attribute *attr,
+			   char *buf, loff_t off, size_t count)
+#else
+static ssize_t ec_ram_read(struct file *filp, struct kobject *kobj,
+			   struct bin_attribute *attr,
+			   char *buf, loff_t off, size_t count)
+#endif
+{
+	int result;
 
-static struct attribute *msi_debug_attrs[] = {
-	&dev_attr_fw_version.attr,
-	&dev_attr_ec_dump.attr,
+	// the sysfs core clamps off + count to the attribute size
+	result = ec_read_seq(off, buf, count);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0))
+static ssize_t ec_ram_write(struct file *filp, struct kobject *kobj,
+			    const struct bin_attribute *attr,
+			    char *buf, loff_t off, size_t count)
+#else
+static ssize_t ec_ram_write(struct file *filp, struct kobject *kobj,
+			    struct bin_attribute *attr,
+			    char *buf, loff_t off, size_t count)
+#endif
+{
+	int result;
+
+	ec_write_flush();
+	result = ec_write_seq(off, buf, count);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+/*
+ * EC watch: polls the addresses selected with the watch attribute every
+ * watch_ms milliseconds and logs every change of their values, which is
+ * drained by reading watch_log. The first poll after a selection only
+ * records the reference values.
+ */
+#define EC_WATCH_LOG_SIZE 512 // power of 2
+
+struct ec_watch_record {
+	u64 timestamp; // boot time, ns
+	u8 addr;
+	u8 old;
+	u8 new;
+};
+
+static DEFINE_MUTEX(ec_watch_mutex);
+static DECLARE_BITMAP(ec_watch_selected, MSI_EC_RAM_SIZE);
+static DECLARE_BITMAP(ec_watch_known, MSI_EC_RAM_SIZE); // ec_watch_prev is valid
+static u8 ec_watch_prev[MSI_EC_RAM_SIZE];
+static unsigned int ec_watch_interval_ms = 100;
+static struct ec_watch_record ec_watch_log[EC_WATCH_LOG_SIZE];
+static unsigned int ec_watch_head; // free-running, masked on access
+static unsigned int ec_watch_tail;
+
+static void ec_watch_push(u64 timestamp, u8 addr, u8 old, u8 new)
+{
+	struct ec_watch_record *record;
+
+	lockdep_assert_held(&ec_watch_mutex);
+
+	// the oldest record is dropped when the log is full
+	if (ec_watch_head - ec_watch_tail == EC_WATCH_LOG_SIZE)
+		ec_watch_tail++;
+
+	record = &ec_watch_log[ec_watch_head++ & (EC_WATCH_LOG_SIZE - 1)];
+	record->timestamp = timestamp;
+	record->addr = addr;
+	record->old = old;
+	record->new = new;
+}
+
+static void ec_watch_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ec_watch_work, ec_watch_work_fn);
+
+static void ec_watch_work_fn(struct work_struct *work)
+{
+	u8 rdata[MSI_EC_RAM_SIZE];
+	unsigned int addr, interval;
+	bool changed = false;
+	u64 timestamp;
+
+	mutex_lock(&ec_watch_mutex);
+	if (bitmap_empty(ec_watch_selected, MSI_EC_RAM_SIZE)) {
+		mutex_unlock(&ec_watch_mutex);
+		return;
+	}
+
+	// a failed poll is retried on the next period
+	if (ec_read_ranges(ec_watch_selected, rdata) == 0) {
+		timestamp = ktime_get_boottime_ns();
+
+		for_each_set_bit(addr, ec_watch_selected, MSI_EC_RAM_SIZE) {
+			if (test_bit(addr, ec_watch_known) &&
+			    ec_watch_prev[addr] != rdata[addr]) {
+				ec_watch_push(timestamp, addr,
+					      ec_watch_prev[addr], rdata[addr]);
+				changed = true;
+			}
+			ec_watch_prev[addr] = rdata[addr];
+		}
+		bitmap_or(ec_watch_known, ec_watch_known, ec_watch_selected,
+			  MSI_EC_RAM_SIZE);
+	}
+	interval = ec_watch_interval_ms;
+	mutex_unlock(&ec_watch_mutex);
+
+	if (changed)
+		sysfs_notify(&msi_platform_device->dev.kobj, "debug", "watch_log");
+
+	queue_delayed_work(system_freezable_wq, &ec_watch_work,
+			   msecs_to_jiffies(interval));
+}
+
+// watch. selects the watched addresses. Format: "xx-xx,xx", xx - hex u8, or "none"
+static ssize_t watch_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	DECLARE_BITMAP(selected, MSI_EC_RAM_SIZE);
+	int result;
+
+	if (sysfs_streq(buf, "none")) {
+		mutex_lock(&ec_watch_mutex);
+		bitmap_zero(ec_watch_selected, MSI_EC_RAM_SIZE);
+		mutex_unlock(&ec_watch_mutex);
+
+		cancel_delayed_work_sync(&ec_watch_work);
+		return count;
+	}
+
+	result = parse_address_ranges(buf, count, selected);
+	if (result < 0)
+		return result;
+
+	mutex_lock(&ec_watch_mutex);
+	bitmap_copy(ec_watch_selected, selected, MSI_EC_RAM_SIZE);
+	bitmap_zero(ec_watch_known, MSI_EC_RAM_SIZE);
+	mutex_unlock(&ec_watch_mutex);
+
+	mod_delayed_work(system_freezable_wq, &ec_watch_work, 0);
+
+	return count;
+}
+
+static ssize_t watch_show(struct device *device, struct device_attribute *attr,
+			  char *buf)
+{
+	int count;
+
+	mutex_lock(&ec_watch_mutex);
+	if (bitmap_empty(ec_watch_selected, MSI_EC_RAM_SIZE))
+		count = sysfs_emit(buf, "%s", "none");
+	else
+		count = emit_address_ranges(ec_watch_selected, buf);
+	mutex_unlock(&ec_watch_mutex);
+
+	count += sysfs_emit_at(buf, count, "\n");
+
+	return count;
+}
+
+// watch_ms. polling period of the watch, in milliseconds
+static ssize_t watch_ms_store(struct device *dev, struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	unsigned int value;
+	int result;
+
+	result = kstrtouint(buf, 10, &value);
+	if (result < 0)
+		return result;
+
+	if (value == 0)
+		return -EINVAL;
+
+	mutex_lock(&ec_watch_mutex);
+	ec_watch_interval_ms = value;
+	mutex_unlock(&ec_watch_mutex);
+
+	return count;
+}
+
+static ssize_t watch_ms_show(struct device *device,
+			     struct device_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", READ_ONCE(ec_watch_interval_ms));
+}
+
+/*
+ * watch_log. drains the logged changes, oldest first, as many as fit in
+ * a page. Format: "timestamp address old new", hex bytes
+ */
+static ssize_t watch_log_show(struct device *device,
+			      struct device_attribute *attr, char *buf)
+{
+	const struct ec_watch_record *record;
+	int count = 0;
+
+	mutex_lock(&ec_watch_mutex);
+	while (ec_watch_tail != ec_watch_head &&
+	       count < PAGE_SIZE - 64) {
+		record = &ec_watch_log[ec_watch_tail++ & (EC_WATCH_LOG_SIZE - 1)];
+		count += sysfs_emit_at(buf, count, "%llu %02x %02x %02x\n",
+				       record->timestamp, record->addr,
+				       record->old, record->new);
+	}
+	mutex_unlock(&ec_watch_mutex);
+
+	return count;
+}
+
+/*
+ * conf_override. changes fields of the live configuration. Format: space,
+ * comma or newline separated "field=xx" pairs, xx - hex, or "none" for
+ * the addresses. Fields are named as in struct msi_ec_conf, and mode
+ * values as "shift_mode.<mode>" or "fan_mode.<mode>".
+ */
+struct conf_field {
+	const char *name;
+	size_t offset;
+	size_t size;
+	u8 max;
+	bool address;
+};
+
+#define CONF_FIELD(field, field_max, is_address) {			\
+	.name = #field,							\
+	.offset = offsetof(struct msi_ec_conf, field),			\
+	.size = sizeof_field(struct msi_ec_conf, field),		\
+	.max = field_max,						\
+	.address = is_address,						\
+}
+
+#define CONF_ADDRESS(field) CONF_FIELD(field, U8_MAX, true)
+#define CONF_VALUE(field, max) CONF_FIELD(field, max, false)
+
+static const struct conf_field conf_fields[] = {
+	CONF_ADDRESS(charge_control_address),
+	CONF_ADDRESS(webcam.address),
+	CONF_ADDRESS(webcam.block_address),
+	CONF_VALUE(webcam.bit, 7),
+	CONF_ADDRESS(fn_win_swap.address),
+	CONF_VALUE(fn_win_swap.bit, 7),
+	CONF_VALUE(fn_win_swap.invert, 1),
+	CONF_ADDRESS(cooler_boost.address),
+	CONF_VALUE(cooler_boost.bit, 7),
+	CONF_ADDRESS(shift_mode.address),
+	CONF_ADDRESS(super_battery.address),
+	CONF_VALUE(super_battery.mask, U8_MAX),
+	CONF_ADDRESS(fan_mode.address),
+	CONF_ADDRESS(cpu.rt_temp_address),
+	CONF_ADDRESS(cpu.rt_fan_speed_address),
+	CONF_ADDRESS(gpu.rt_temp_address),
+	CONF_ADDRESS(gpu.rt_fan_speed_address),
+	CONF_ADDRESS(leds.micmute_led_address),
+	CONF_ADDRESS(leds.mute_led_address),
+	CONF_VALUE(leds.bit, 7),
+	CONF_ADDRESS(kbd_bl.bl_mode_address),
+	CONF_ADDRESS(kbd_bl.bl_state_address),
+	CONF_VALUE(kbd_bl.state_base_value, U8_MAX),
+	CONF_VALUE(kbd_bl.max_state, MSI_EC_KBD_BL_STATE_MASK),
+};
+
+static int conf_override_apply(const struct msi_ec_conf *new_conf);
+
+static int conf_override_mode(struct msi_ec_mode *modes, const char *name,
+			      const char *value)
+{
+	int i = find_mode_by_name(modes, name);
+
+	if (i < 0)
+		return i;
+
+	return kstrtou8(value, 16, &modes[i].value);
+}
+
+static int conf_override_pair(struct msi_ec_conf *new_conf, const char *key,
+			      const char *value)
+{
+	const struct conf_field *field = NULL;
+	u16 parsed;
+	int result;
+
+	if (str_has_prefix(key, "shift_mode.") &&
+	    strcmp(key, "shift_mode.address"))
+		return conf_override_mode(new_conf->shift_mode.modes,
+					  key + strlen("shift_mode."), value);
+
+	if (str_has_prefix(key, "fan_mode.") &&
+	    strcmp(key, "fan_mode.address"))
+		return conf_override_mode(new_conf->fan_mode.modes,
+					  key + strlen("fan_mode."), value);
+
+	for (int i = 0; i < ARRAY_SIZE(conf_fields); i++) {
+		if (!strcmp(conf_fields[i].name, key)) {
+			field = &conf_fields[i];
+			break;
+		}
+	}
+	if (!field)
+		return -EINVAL;
+
+	if (field->address && !strcmp(value, "none")) {
+		parsed = MSI_EC_ADDR_UNSUPP;
+	} else {
+		result = kstrtou16(value, 16, &parsed);
+		if (result < 0)
+			return result;
+
+		if (parsed > field->max)
+			return -EINVAL;
+	}
+
+	if (field->size == sizeof(u16))
+		*(u16 *)((u8 *)new_conf + field->offset) = parsed;
+	else
+		*((u8 *)new_conf + field->offset) = parsed;
+
+	return 0;
+}
+
+static ssize_t conf_override_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct msi_ec_conf new_conf;
+	char *str, *cur, *token;
+	int result = 0;
+
+	if (!conf_loaded)
+		return -ENODEV;
+
+	memcpy(&new_conf, &conf, sizeof(new_conf));
+
+	str = kstrndup(buf, count, GFP_KERNEL);
+	if (!str)
+		return -ENOMEM;
+
+	cur = str;
+	while (result == 0 && (token = strsep(&cur, " ,\n"))) {
+		char *value;
+
+		if (!*token)
+			continue;
+
+		value = strchr(token, '=');
+		if (!value) {
+			result = -EINVAL;
+			break;
+		}
+		*value++ = '\0';
+
+		result = conf_override_pair(&new_conf, token, value);
+	}
+	kfree(str);
+
+	if (result < 0)
+		return result;
+
+	result = conf_override_apply(&new_conf);
+	if (result < 0)
+		return result;
+
+	return count;
+}
+
+static ssize_t conf_override_show(struct device *device,
+				  struct device_attribute *attr, char *buf)
+{
+	int count = 0;
+
+	if (!conf_loaded)
+		return -ENODEV;
+
+	for (int i = 0; i < ARRAY_SIZE(conf_fields); i++) {
+		const struct conf_field *field = &conf_fields[i];
+		const u8 *ptr = (const u8 *)&conf + field->offset;
+		u16 value = field->size == sizeof(u16) ? *(const u16 *)ptr : *ptr;
+
+		if (field->address && value == MSI_EC_ADDR_UNSUPP)
+			count += sysfs_emit_at(buf, count, "%s=none\n",
+					       field->name);
+		else
+			count += sysfs_emit_at(buf, count, "%s=%02x\n",
+					       field->name, value);
+	}
+
+	for (int i = 0; conf.shift_mode.modes[i].name; i++)
+		count += sysfs_emit_at(buf, count, "shift_mode.%s=%02x\n",
+				       conf.shift_mode.modes[i].name,
+				       conf.shift_mode.modes[i].value);
+
+	for (int i = 0; conf.fan_mode.modes[i].name; i++)
+		count += sysfs_emit_at(buf, count, "fan_mode.%s=%02x\n",
+				       conf.fan_mode.modes[i].name,
+				       conf.fan_mode.modes[i].value);
+
+	return count;
+}
+
+static DEVICE_ATTR_RO(ec_dump);
+static DEVICE_ATTR_RW(ec_dump_ranges);
+static DEVICE_ATTR_RW(ec_dump_delta);
+static DEVICE_ATTR_WO(ec_set);
+static DEVICE_ATTR_RW(ec_get);
+static DEVICE_ATTR_RW(watch);
+static DEVICE_ATTR_RW(watch_ms);
+static DEVICE_ATTR_RW(conf_override);
+static DEVICE_ATTR_RO(watch_log);
+static BIN_ATTR_RW(ec_ram, MSI_EC_RAM_SIZE);
+
+static struct attribute *msi_debug_attrs[] = {
+	&dev_attr_fw_version.attr,
+	&dev_attr_ec_dump.attr,
+	&dev_attr_ec_dump_ranges.attr,
+	&dev_attr_ec_dump_delta.attr,
 	&dev_attr_ec_set.attr,
 	&dev_attr_ec_get.attr,
+	&dev_attr_watch.attr,
+	&dev_attr_watch_ms.attr,
+	&dev_attr_watch_log.attr,
+	&dev_attr_conf_override.attr,
+	NULL
+};
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0))
+static const struct bin_attribute *const msi_debug_bin_attrs[] = {
+#else
+static struct bin_attribute *msi_debug_bin_attrs[] = {
+#endif
+	&bin_attr_ec_ram,
 	NULL
 };
 
@@ -4180,25 +6319,74 @@ static int mute_led_sysfs_set(struct led_classdev *led_cdev,
 static enum led_brightness kbd_bl_sysfs_get(struct led_classdev *led_cdev)
 {
 	u8 rdata;
-	int result = ec_read(conf.kbd_bl.bl_state_address, &rdata);
+	int result = ec_read_cached(conf.kbd_bl.bl_state_address, &rdata);
 	if (result < 0)
 		return 0;
 	return rdata & MSI_EC_KBD_BL_STATE_MASK;
 }
 
+static struct led_classdev msiacpi_led_kbdlight;
+
+/*
+ * The last brightness written by the driver, or -1. The sampler reports
+ * the brightness changes it sees as hardware changes, e.g. made with the
+ * Fn hotkey, except the one caused by the driver's own write.
+ */
+static atomic_t kbd_bl_written = ATOMIC_INIT(-1);
+
+static int kbd_bl_write(u8 brightness)
+{
+	int result;
+
+	atomic_set(&kbd_bl_written, brightness);
+	result = ec_store_bits(conf.kbd_bl.bl_state_address, 0xff,
+			       conf.kbd_bl.state_base_value | brightness);
+	if (result < 0)
+		atomic_set(&kbd_bl_written, -1);
+
+	return result;
+}
+
+static void kbd_bl_notify_changed(u8 brightness)
+{
+	if (atomic_xchg(&kbd_bl_written, -1) != brightness)
+		led_classdev_notify_brightness_hw_changed(&msiacpi_led_kbdlight,
+							  brightness);
+}
+
+// with kbd_bl_debounce_ms, only the last of a burst of sets is written
+static u8 kbd_bl_pending;
+
+static void kbd_bl_work_fn(struct work_struct *work)
+{
+	int result = kbd_bl_write(READ_ONCE(kbd_bl_pending));
+
+	if (result < 0)
+		pr_warn("failed to set the keyboard backlight: %d\n", result);
+}
+
+static DECLARE_DELAYED_WORK(kbd_bl_work, kbd_bl_work_fn);
+
 static int kbd_bl_sysfs_set(struct led_classdev *led_cdev,
 			    enum led_brightness brightness)
 {
+	unsigned int debounce_ms = READ_ONCE(kbd_bl_debounce_ms);
+
 	// By default, on an unregister event,
 	// kernel triggers the setter with 0 brightness.
 	if (led_cdev->flags & LED_UNREGISTERING)
 		return 0;
 
-	u8 wdata;
 	if (brightness < 0 || brightness > 3)
 		return -1;
-	wdata = conf.kbd_bl.state_base_value | brightness;
-	return ec_write(conf.kbd_bl.bl_state_address, wdata);
+
+	if (!debounce_ms)
+		return kbd_bl_write(brightness);
+
+	WRITE_ONCE(kbd_bl_pending, brightness);
+	mod_delayed_work(system_wq, &kbd_bl_work, msecs_to_jiffies(debounce_ms));
+
+	return 0;
 }
 
 static struct led_classdev micmute_led_cdev = {
@@ -4223,19 +6411,561 @@ static struct led_classdev msiacpi_led_kbdlight = {
 	.brightness_get = &kbd_bl_sysfs_get,
 };
 
+// the classdevs of the supported LEDs, tracked to follow conf overrides
+static struct led_classdev *const msi_leds[] = {
+	&micmute_led_cdev,
+	&mute_led_cdev,
+	&msiacpi_led_kbdlight,
+};
+
+static bool msi_leds_registered[ARRAY_SIZE(msi_leds)];
+
+static bool msi_led_supported(int i)
+{
+	if (msi_leds[i] == &micmute_led_cdev)
+		return conf.leds.micmute_led_address != MSI_EC_ADDR_UNSUPP;
+
+	if (msi_leds[i] == &mute_led_cdev)
+		return conf.leds.mute_led_address != MSI_EC_ADDR_UNSUPP;
+
+	return conf.kbd_bl.bl_state_address != MSI_EC_ADDR_UNSUPP;
+}
+
+static void msi_leds_register(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(msi_leds); i++) {
+		if (msi_leds_registered[i] || !msi_led_supported(i))
+			continue;
+
+		// set by a previous unregistration
+		msi_leds[i]->flags &= ~LED_UNREGISTERING;
+
+		msi_leds_registered[i] =
+			led_classdev_register(&msi_platform_device->dev,
+					      msi_leds[i]) == 0;
+	}
+}
+
+static void msi_leds_unregister(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(msi_leds); i++) {
+		if (!msi_leds_registered[i])
+			continue;
+
+		led_classdev_unregister(msi_leds[i]);
+		msi_leds_registered[i] = false;
+	}
+
+	flush_delayed_work(&kbd_bl_work);
+}
+
+// ============================================================ //
+// Hwmon subsystem
+// ============================================================ //
+
+/*
+ * Channel 0 is CPU and channel 1 is GPU. The EC reports fan speeds in
+ * percent rather than RPM, so they are exported as read-only pwm channels.
+ */
+static const char *const msi_hwmon_labels[] = { "CPU", "GPU" };
+
+static int msi_hwmon_address(enum hwmon_sensor_types type, int channel)
+{
+	switch (type) {
+	case hwmon_temp:
+		return channel ? conf.gpu.rt_temp_address
+			       : conf.cpu.rt_temp_address;
+	case hwmon_pwm:
+		return channel ? conf.gpu.rt_fan_speed_address
+			       : conf.cpu.rt_fan_speed_address;
+	default:
+		return MSI_EC_ADDR_UNSUPP;
+	}
+}
+
+static umode_t msi_hwmon_is_visible(const void *data,
+				    enum hwmon_sensor_types type,
+				    u32 attr, int channel)
+{
+	return msi_hwmon_address(type, channel) == MSI_EC_ADDR_UNSUPP ? 0 : 0444;
+}
+
+static int msi_hwmon_read(struct device *dev, enum hwmon_sensor_types type,
+			  u32 attr, int channel, long *val)
+{
+	int address = msi_hwmon_address(type, channel);
+	u8 rdata;
+	int result;
+
+	// the channels are kept when a configuration override unsets them
+	if (address == MSI_EC_ADDR_UNSUPP)
+		return -EOPNOTSUPP;
+
+	result = ec_read_cached(address, &rdata);
+	if (result < 0)
+		return result;
+
+	switch (type) {
+	case hwmon_temp:
+		*val = rdata * 1000; // millidegrees Celsius
+		return 0;
+	case hwmon_pwm:
+		*val = min(rdata * 255 / 100, 255); // percent to 0-255
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int msi_hwmon_read_string(struct device *dev,
+				 enum hwmon_sensor_types type,
+				 u32 attr, int channel, const char **str)
+{
+	*str = msi_hwmon_labels[channel];
+	return 0;
+}
+
+static const struct hwmon_ops msi_hwmon_ops = {
+	.is_visible = msi_hwmon_is_visible,
+	.read = msi_hwmon_read,
+	.read_string = msi_hwmon_read_string,
+};
+
+static const struct hwmon_channel_info *msi_hwmon_info[] = {
+	HWMON_CHANNEL_INFO(temp,
+			   HWMON_T_INPUT | HWMON_T_LABEL,
+			   HWMON_T_INPUT | HWMON_T_LABEL),
+	HWMON_CHANNEL_INFO(pwm,
+			   HWMON_PWM_INPUT,
+			   HWMON_PWM_INPUT),
+	NULL
+};
+
+static const struct hwmon_chip_info msi_hwmon_chip_info = {
+	.ops = &msi_hwmon_ops,
+	.info = msi_hwmon_info,
+};
+
+// ============================================================ //
+// Platform profile
+// ============================================================ //
+
+#ifdef MSI_EC_PLATFORM_PROFILE
+
+/*
+ * Platform profiles are applied as a shift mode, plus the super battery
+ * state and optionally a fan mode, written in a single batch. The first
+ * entry of a profile whose shift mode is supported is used, and a shift
+ * mode read back is reported as the first profile using it, so balanced
+ * comes before quiet. Quiet only differs from balanced by its fan mode,
+ * so it is only offered with platform_profile_fan_mode.
+ */
+struct msi_platform_profile {
+	enum platform_profile_option profile;
+	const char *shift_mode;
+	const char *fan_mode;
+	bool super_battery;
+	bool needs_fan_mode;
+};
+
+static const struct msi_platform_profile msi_platform_profiles[] = {
+	{ PLATFORM_PROFILE_LOW_POWER,            SM_ECO_NAME,     FM_SILENT_NAME, true,  false },
+	{ PLATFORM_PROFILE_BALANCED,             SM_COMFORT_NAME, FM_AUTO_NAME,   false, false },
+	{ PLATFORM_PROFILE_QUIET,                SM_COMFORT_NAME, FM_SILENT_NAME, false, true  },
+	{ PLATFORM_PROFILE_BALANCED_PERFORMANCE, SM_SPORT_NAME,   FM_AUTO_NAME,   false, false },
+	{ PLATFORM_PROFILE_PERFORMANCE,          SM_TURBO_NAME,   FM_AUTO_NAME,   false, false },
+	{ PLATFORM_PROFILE_PERFORMANCE,          SM_SPORT_NAME,   FM_AUTO_NAME,   false, false },
+};
+
+static struct device *msi_platform_profile_dev;
+static const struct msi_platform_profile *msi_platform_profile_last;
+
+static const struct msi_platform_profile *
+platform_profile_find(enum platform_profile_option profile)
+{
+	for (int i = 0; i < ARRAY_SIZE(msi_platform_profiles); i++) {
+		const struct msi_platform_profile *entry = &msi_platform_profiles[i];
+
+		if (entry->needs_fan_mode &&
+		    (!READ_ONCE(platform_profile_fan_mode) ||
+		     conf.fan_mode.address == MSI_EC_ADDR_UNSUPP ||
+		     find_mode_by_name(conf.fan_mode.modes, entry->fan_mode) < 0))
+			continue;
+
+		if (entry->profile == profile &&
+		    find_mode_by_name(conf.shift_mode.modes, entry->shift_mode) >= 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static u8 platform_profile_shift_value(const struct msi_platform_profile *entry)
+{
+	return conf.shift_mode.modes[find_mode_by_name(conf.shift_mode.modes,
+						       entry->shift_mode)].value;
+}
+
+static int msi_platform_profile_probe(void *drvdata, unsigned long *choices)
+{
+	for (int i = 0; i < ARRAY_SIZE(msi_platform_profiles); i++) {
+		const struct msi_platform_profile *entry = &msi_platform_profiles[i];
+
+		if (platform_profile_find(entry->profile) == entry)
+			set_bit(entry->profile, choices);
+	}
+
+	return 0;
+}
+
+static int msi_platform_profile_get(struct device *dev,
+				    enum platform_profile_option *profile)
+{
+	const struct msi_platform_profile *last = READ_ONCE(msi_platform_profile_last);
+	int result;
+	u8 rdata;
+
+	// registered on load, the shift mode may be unset by an override
+	if (conf.shift_mode.address == MSI_EC_ADDR_UNSUPP)
+		return -EOPNOTSUPP;
+
+	result = ec_read_cached(conf.shift_mode.address, &rdata);
+	if (result < 0)
+		return result;
+
+	// several profiles may share a shift mode, prefer the one last set
+	if (last && platform_profile_shift_value(last) == rdata) {
+		*profile = last->profile;
+		return 0;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(msi_platform_profiles); i++) {
+		const struct msi_platform_profile *entry = &msi_platform_profiles[i];
+
+		if (platform_profile_find(entry->profile) == entry &&
+		    platform_profile_shift_value(entry) == rdata) {
+			*profile = entry->profile;
+			return 0;
+		}
+	}
+
+	// e.g. "unspecified" or a mode without a profile
+	*profile = PLATFORM_PROFILE_CUSTOM;
+	return 0;
+}
+
+static int msi_platform_profile_set(struct device *dev,
+				    enum platform_profile_option profile)
+{
+	const struct msi_platform_profile *entry = platform_profile_find(profile);
+	struct ec_batch batch = {};
+	int result;
+	int i;
+
+	if (!entry || conf.shift_mode.address == MSI_EC_ADDR_UNSUPP)
+		return -EOPNOTSUPP;
+
+	ec_batch_add(&batch, conf.shift_mode.address, 0xff,
+		     platform_profile_shift_value(entry));
+
+	if (conf.super_battery.address != MSI_EC_ADDR_UNSUPP)
+		ec_batch_add(&batch, conf.super_battery.address,
+			     conf.super_battery.mask,
+			     entry->super_battery ? conf.super_battery.mask : 0);
+
+	if (READ_ONCE(platform_profile_fan_mode) &&
+	    conf.fan_mode.address != MSI_EC_ADDR_UNSUPP) {
+		i = find_mode_by_name(conf.fan_mode.modes, entry->fan_mode);
+		if (i >= 0)
+			ec_batch_add(&batch, conf.fan_mode.address, 0xff,
+				     conf.fan_mode.modes[i].value);
+	}
+
+	ec_write_flush();
+	result = ec_batch_commit(&batch);
+	if (result < 0)
+		return result;
+
+	WRITE_ONCE(msi_platform_profile_last, entry);
+
+	return 0;
+}
+
+static const struct platform_profile_ops msi_platform_profile_ops = {
+	.probe = msi_platform_profile_probe,
+	.profile_get = msi_platform_profile_get,
+	.profile_set = msi_platform_profile_set,
+};
+
+static void msi_platform_profile_register(struct device *dev)
+{
+	struct device *ppdev;
+
+	if (conf.shift_mode.address == MSI_EC_ADDR_UNSUPP)
+		return;
+
+	// the driver remains usable without it
+	ppdev = devm_platform_profile_register(dev, MSI_EC_DRIVER_NAME, NULL,
+					       &msi_platform_profile_ops);
+	if (IS_ERR(ppdev)) {
+		pr_warn("failed to register the platform profile: %ld\n",
+			PTR_ERR(ppdev));
+		return;
+	}
+
+	msi_platform_profile_dev = ppdev;
+}
+
+static void msi_platform_profile_notify(void)
+{
+	if (msi_platform_profile_dev)
+		platform_profile_notify(msi_platform_profile_dev);
+}
+
+#else
+
+static void msi_platform_profile_register(struct device *dev) {}
+static void msi_platform_profile_notify(void) {}
+
+#endif
+
+// ============================================================ //
+// Shadow registers
+// ============================================================ //
+
+// marks the control registers as shadowed and fills their copies
+static void shadow_init(void)
+{
+	const int addrs[] = {
+		conf.webcam.address,
+		conf.webcam.block_address,
+		conf.fn_win_swap.address,
+		conf.leds.micmute_led_address,
+		conf.leds.mute_led_address,
+		conf.kbd_bl.bl_state_address,
+	};
+	u8 rdata[ARRAY_SIZE(addrs)];
+
+	// also called after a configuration override
+	bitmap_zero(ec_shadowed, MSI_EC_RAM_SIZE);
+	bitmap_zero(ec_pinned, MSI_EC_RAM_SIZE);
+
+	for (int i = 0; i < ARRAY_SIZE(addrs); i++) {
+		if (addrs[i] != MSI_EC_ADDR_UNSUPP)
+			set_bit(addrs[i], ec_shadowed);
+	}
+
+	if (shadow_ms)
+		ec_read_list(addrs, rdata, ARRAY_SIZE(addrs));
+
+	// polled by upower, and only ever changed through the driver
+	if (charge_control_supported)
+		set_bit(conf.charge_control_address, ec_pinned);
+}
+
+// ============================================================ //
+// Sensor sampler
+// ============================================================ //
+
+#define MSI_EC_SAMPLES_COUNT 1024
+
+// a record of the samples file, the layout is a part of the ABI
+struct msi_ec_sample {
+	u64 timestamp; // CLOCK_BOOTTIME, ns
+	u8 cpu_temp;
+	u8 cpu_fan_speed;
+	u8 gpu_temp;
+	u8 gpu_fan_speed;
+	u8 reserved[4];
+};
+
+static DEFINE_MUTEX(sampler_mutex);
+static struct msi_ec_sample sampler_buf[MSI_EC_SAMPLES_COUNT];
+static unsigned int sampler_head; // free-running index of the next record
+static unsigned int sampler_tail; // free-running index of the oldest record
+
+static void sampler_push(const struct msi_ec_sample *sample)
+{
+	mutex_lock(&sampler_mutex);
+	// overwrite the oldest record when the buffer is full
+	if (sampler_head - sampler_tail == MSI_EC_SAMPLES_COUNT)
+		sampler_tail++;
+
+	sampler_buf[sampler_head % MSI_EC_SAMPLES_COUNT] = *sample;
+	sampler_head++;
+	mutex_unlock(&sampler_mutex);
+}
+
+// values read by the sampler on every tick
+enum sampler_value {
+	SAMPLER_CPU_TEMP,
+	SAMPLER_CPU_FAN_SPEED,
+	SAMPLER_GPU_TEMP,
+	SAMPLER_GPU_FAN_SPEED,
+	SAMPLER_SHIFT_MODE,
+	SAMPLER_FAN_MODE,
+	SAMPLER_COOLER_BOOST,
+	SAMPLER_KBD_BL,
+	SAMPLER_VALUES_COUNT
+};
+
+/*
+ * Attributes to notify through sysfs_notify() when a sampled value changes.
+ * Mode changes additionally emit a KOBJ_CHANGE uevent.
+ */
+static const struct {
+	const char *group;
+	const char *attr;
+	bool uevent;
+} sampler_watches[SAMPLER_VALUES_COUNT] = {
+	[SAMPLER_CPU_TEMP]      = { "cpu", "realtime_temperature", false },
+	[SAMPLER_CPU_FAN_SPEED] = { "cpu", "realtime_fan_speed",   false },
+	[SAMPLER_GPU_TEMP]      = { "gpu", "realtime_temperature", false },
+	[SAMPLER_GPU_FAN_SPEED] = { "gpu", "realtime_fan_speed",   false },
+	[SAMPLER_SHIFT_MODE]    = { NULL,  "shift_mode",           true  },
+	[SAMPLER_FAN_MODE]      = { NULL,  "fan_mode",             true  },
+	[SAMPLER_COOLER_BOOST]  = { NULL,  "cooler_boost",         true  },
+	[SAMPLER_KBD_BL]        = { }, // reported through the LED classdev
+};
+
+static u8 sampler_last[SAMPLER_VALUES_COUNT];
+static bool sampler_primed = false;
+
+static void sampler_notify_changes(const u8 *values)
+{
+	struct kobject *kobj = &msi_platform_device->dev.kobj;
+
+	for (int i = 0; i < SAMPLER_VALUES_COUNT; i++) {
+		if (!sampler_primed || values[i] == sampler_last[i])
+			continue;
+
+		if (i == SAMPLER_KBD_BL) {
+			kbd_bl_notify_changed(values[i]);
+			continue;
+		}
+
+		sysfs_notify(kobj, sampler_watches[i].group,
+			     sampler_watches[i].attr);
+
+		if (i == SAMPLER_SHIFT_MODE)
+			msi_platform_profile_notify();
+
+		if (sampler_watches[i].uevent) {
+			char env[32];
+			char *envp[] = { env, NULL };
+
+			snprintf(env, sizeof(env), "MSI_EC_ATTR=%s",
+				 sampler_watches[i].attr);
+			kobject_uevent_env(kobj, KOBJ_CHANGE, envp);
+		}
+	}
+
+	memcpy(sampler_last, values, sizeof(sampler_last));
+	sampler_primed = true;
+}
+
+static void sampler_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(sampler_work, sampler_work_fn);
+
+static void sampler_work_fn(struct work_struct *work)
+{
+	const int addrs[SAMPLER_VALUES_COUNT] = {
+		[SAMPLER_CPU_TEMP]      = conf.cpu.rt_temp_address,
+		[SAMPLER_CPU_FAN_SPEED] = conf.cpu.rt_fan_speed_address,
+		[SAMPLER_GPU_TEMP]      = conf.gpu.rt_temp_address,
+		[SAMPLER_GPU_FAN_SPEED] = conf.gpu.rt_fan_speed_address,
+		[SAMPLER_SHIFT_MODE]    = conf.shift_mode.address,
+		[SAMPLER_FAN_MODE]      = conf.fan_mode.address,
+		[SAMPLER_COOLER_BOOST]  = conf.cooler_boost.address,
+		[SAMPLER_KBD_BL]        = conf.kbd_bl.bl_state_address,
+	};
+	u8 rdata[SAMPLER_VALUES_COUNT];
+	struct msi_ec_sample sample = {};
+
+	if (ec_read_list(addrs, rdata, SAMPLER_VALUES_COUNT) == 0) {
+		// other bits of the cooler boost byte are unrelated
+		rdata[SAMPLER_COOLER_BOOST] &= BIT(conf.cooler_boost.bit);
+		rdata[SAMPLER_KBD_BL] &= MSI_EC_KBD_BL_STATE_MASK;
+
+		sample.timestamp     = ktime_get_boottime_ns();
+		sample.cpu_temp      = rdata[SAMPLER_CPU_TEMP];
+		sample.cpu_fan_speed = rdata[SAMPLER_CPU_FAN_SPEED];
+		sample.gpu_temp      = rdata[SAMPLER_GPU_TEMP];
+		sample.gpu_fan_speed = rdata[SAMPLER_GPU_FAN_SPEED];
+		sampler_push(&sample);
+
+		sampler_notify_changes(rdata);
+
+		if (conf.cpu.rt_temp_address != MSI_EC_ADDR_UNSUPP) {
+			temp_stats_update(&cpu_temp_stats, rdata[SAMPLER_CPU_TEMP]);
+			temp_alarm_update(&cpu_temp_alarm, "cpu", rdata[SAMPLER_CPU_TEMP]);
+		}
+		if (conf.gpu.rt_temp_address != MSI_EC_ADDR_UNSUPP) {
+			temp_stats_update(&gpu_temp_stats, rdata[SAMPLER_GPU_TEMP]);
+			temp_alarm_update(&gpu_temp_alarm, "gpu", rdata[SAMPLER_GPU_TEMP]);
+		}
+
+		fan_curve_update(max(rdata[SAMPLER_CPU_TEMP],
+				     rdata[SAMPLER_GPU_TEMP]));
+	}
+
+	queue_delayed_work(system_freezable_wq, &sampler_work,
+			   msecs_to_jiffies(sampler_ms));
+}
+
+static void sampler_start(void)
+{
+	if (sampler_ms)
+		queue_delayed_work(system_freezable_wq, &sampler_work, 0);
+}
+
+static void sampler_stop(void)
+{
+	if (sampler_ms)
+		cancel_delayed_work_sync(&sampler_work);
+}
+
+// samples. drains whole records from the ring buffer, oldest first
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 17, 0))
+static ssize_t samples_read(struct file *filp, struct kobject *kobj,
+			    const struct bin_attribute *attr,
+			    char *buf, loff_t off, size_t count)
+#else
+static ssize_t samples_read(struct file *filp, struct kobject *kobj,
+			    struct bin_attribute *attr,
+			    char *buf, loff_t off, size_t count)
+#endif
+{
+	size_t n = 0;
+
+	if (count < sizeof(struct msi_ec_sample))
+		return -EINVAL;
+
+	mutex_lock(&sampler_mutex);
+	while (sampler_tail != sampler_head &&
+	       (n + 1) * sizeof(struct msi_ec_sample) <= count) {
+		memcpy(buf + n * sizeof(struct msi_ec_sample),
+		       &sampler_buf[sampler_tail % MSI_EC_SAMPLES_COUNT],
+		       sizeof(struct msi_ec_sample));
+		sampler_tail++;
+		n++;
+	}
+	mutex_unlock(&sampler_mutex);
+
+	return n * sizeof(struct msi_ec_sample);
+}
+
+static BIN_ATTR_ADMIN_RO(samples, 0);
+
 // ============================================================ //
 // Sysfs platform driver
 // ============================================================ //
 
-static umode_t msi_ec_is_visible(struct kobject *kobj,
-				 struct attribute *attr,
-				 int idx)
+// whether the configuration supports an attribute
+static bool msi_ec_attr_supported(struct attribute *attr)
 {
 	int address;
 
-	if (!conf_loaded)
-		return 0;
-
 	/* root group */
 	if (attr == &dev_attr_webcam.attr)
 		address = conf.webcam.address;
@@ -4261,6 +6991,10 @@ static umode_t msi_ec_is_visible(struct kobject *kobj,
 		 attr == &dev_attr_fan_mode.attr)
 		address = conf.fan_mode.address;
 
+	// the fan curve is evaluated by the sampler
+	else if (attr == &dev_attr_fan_curve.attr)
+		address = sampler_ms ? conf.fan_mode.address : MSI_EC_ADDR_UNSUPP;
+
 	/* cpu group */
 	else if (attr == &dev_attr_cpu_realtime_temperature.attr)
 		address = conf.cpu.rt_temp_address;
@@ -4268,6 +7002,15 @@ static umode_t msi_ec_is_visible(struct kobject *kobj,
 	else if (attr == &dev_attr_cpu_realtime_fan_speed.attr)
 		address = conf.cpu.rt_fan_speed_address;
 
+	else if (attr == &dev_attr_cpu_temperature_average.attr ||
+		 attr == &dev_attr_cpu_temperature_min.attr ||
+		 attr == &dev_attr_cpu_temperature_max.attr ||
+		 attr == &dev_attr_cpu_temperature_samples.attr ||
+		 attr == &dev_attr_cpu_temperature_high.attr ||
+		 attr == &dev_attr_cpu_temperature_low.attr ||
+		 attr == &dev_attr_cpu_temperature_alarm.attr)
+		address = sampler_ms ? conf.cpu.rt_temp_address : MSI_EC_ADDR_UNSUPP;
+
 	/* gpu group */
 	else if (attr == &dev_attr_gpu_realtime_temperature.attr)
 		address = conf.gpu.rt_temp_address;
@@ -4275,32 +7018,82 @@ static umode_t msi_ec_is_visible(struct kobject *kobj,
 	else if (attr == &dev_attr_gpu_realtime_fan_speed.attr)
 		address = conf.gpu.rt_fan_speed_address;
 
+	else if (attr == &dev_attr_gpu_temperature_average.attr ||
+		 attr == &dev_attr_gpu_temperature_min.attr ||
+		 attr == &dev_attr_gpu_temperature_max.attr ||
+		 attr == &dev_attr_gpu_temperature_samples.attr ||
+		 attr == &dev_attr_gpu_temperature_high.attr ||
+		 attr == &dev_attr_gpu_temperature_low.attr ||
+		 attr == &dev_attr_gpu_temperature_alarm.attr)
+		address = sampler_ms ? conf.gpu.rt_temp_address : MSI_EC_ADDR_UNSUPP;
+
 	/* default */
 	else
-		return attr->mode;
+		return true;
+
+	return address != MSI_EC_ADDR_UNSUPP;
+}
+
+/*
+ * Visibility of the attributes of every group, indexed like the attrs
+ * arrays and computed once the configuration is loaded.
+ */
+static DECLARE_BITMAP(msi_root_visible, ARRAY_SIZE(msi_root_attrs));
+static DECLARE_BITMAP(msi_cpu_visible, ARRAY_SIZE(msi_cpu_attrs));
+static DECLARE_BITMAP(msi_gpu_visible, ARRAY_SIZE(msi_gpu_attrs));
+
+static void msi_ec_visibility_init_group(struct attribute **attrs,
+					 unsigned long *visible)
+{
+	for (int i = 0; attrs[i]; i++)
+		assign_bit(i, visible, msi_ec_attr_supported(attrs[i]));
+}
 
-	return address == MSI_EC_ADDR_UNSUPP ? 0 : attr->mode;
+static void msi_ec_visibility_init(void)
+{
+	msi_ec_visibility_init_group(msi_root_attrs, msi_root_visible);
+	msi_ec_visibility_init_group(msi_cpu_attrs, msi_cpu_visible);
+	msi_ec_visibility_init_group(msi_gpu_attrs, msi_gpu_visible);
+}
+
+static umode_t msi_root_is_visible(struct kobject *kobj,
+				   struct attribute *attr, int idx)
+{
+	return conf_loaded && test_bit(idx, msi_root_visible) ? attr->mode : 0;
+}
+
+static umode_t msi_cpu_is_visible(struct kobject *kobj,
+				  struct attribute *attr, int idx)
+{
+	return conf_loaded && test_bit(idx, msi_cpu_visible) ? attr->mode : 0;
+}
+
+static umode_t msi_gpu_is_visible(struct kobject *kobj,
+				  struct attribute *attr, int idx)
+{
+	return conf_loaded && test_bit(idx, msi_gpu_visible) ? attr->mode : 0;
 }
 
 static struct attribute_group msi_root_group = {
-	.is_visible = msi_ec_is_visible,
+	.is_visible = msi_root_is_visible,
 	.attrs = msi_root_attrs,
 };
 
 static struct attribute_group msi_cpu_group = {
 	.name = "cpu",
-	.is_visible = msi_ec_is_visible,
+	.is_visible = msi_cpu_is_visible,
 	.attrs = msi_cpu_attrs,
 };
 static struct attribute_group msi_gpu_group = {
 	.name = "gpu",
-	.is_visible = msi_ec_is_visible,
+	.is_visible = msi_gpu_is_visible,
 	.attrs = msi_gpu_attrs,
 };
 
 static const struct attribute_group msi_debug_group = {
 	.name = "debug",
 	.attrs = msi_debug_attrs,
+	.bin_attrs = msi_debug_bin_attrs,
 };
 
 /* the debug group is created separately if needed */
@@ -4313,7 +7106,26 @@ static const struct attribute_group *msi_platform_groups[] = {
 
 static int __init msi_platform_probe(struct platform_device *pdev)
 {
+	if (conf_loaded) {
+		// hwmon names may not contain dashes
+		struct device *hwmon = devm_hwmon_device_register_with_info(
+			&pdev->dev, "msi_ec", NULL, &msi_hwmon_chip_info, NULL);
+		if (IS_ERR(hwmon))
+			return PTR_ERR(hwmon);
+
+		msi_platform_profile_register(&pdev->dev);
+	}
+
+	if (conf_loaded && sampler_ms) {
+		int result = sysfs_create_bin_file(&pdev->dev.kobj,
+						   &bin_attr_samples);
+		if (result < 0)
+			return result;
+	}
+
 	if (debug) {
+		bitmap_fill(ec_dump_selected, MSI_EC_RAM_SIZE);
+
 		int result = sysfs_create_group(&pdev->dev.kobj,
 						&msi_debug_group);
 		if (result < 0)
@@ -4329,28 +7141,383 @@ static void msi_platform_remove(struct platform_device *pdev)
 static int msi_platform_remove(struct platform_device *pdev)
 #endif
 {
-	if (debug)
+	if (conf_loaded && sampler_ms)
+		sysfs_remove_bin_file(&pdev->dev.kobj, &bin_attr_samples);
+
+	if (debug) {
+		// no writer of debug/watch can re-arm the work past this point
 		sysfs_remove_group(&pdev->dev.kobj, &msi_debug_group);
+		cancel_delayed_work_sync(&ec_watch_work);
+	}
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(6, 11, 0))
 	return 0;
 #endif
 }
 
-static struct platform_device *msi_platform_device;
+// ============================================================ //
+// Power management
+// ============================================================ //
+
+/*
+ * Some firmwares reset the settings on resume. The registers the driver
+ * writes are saved on suspend and the ones found changed on resume are
+ * restored in a single batch.
+ */
+static struct ec_batch pm_saved_state;
+
+static int __maybe_unused msi_ec_suspend(struct device *dev)
+{
+	const struct {
+		int address;
+		u8 mask;
+	} regs[] = {
+		{ charge_control_supported ? conf.charge_control_address
+					   : MSI_EC_ADDR_UNSUPP, 0xff },
+		{ conf.webcam.address, BIT(conf.webcam.bit) },
+		{ conf.webcam.block_address, BIT(conf.webcam.bit) },
+		{ conf.fn_win_swap.address, BIT(conf.fn_win_swap.bit) },
+		{ conf.cooler_boost.address, BIT(conf.cooler_boost.bit) },
+		{ conf.shift_mode.address, 0xff },
+		{ conf.super_battery.address, conf.super_battery.mask },
+		{ conf.fan_mode.address, 0xff },
+		{ conf.leds.micmute_led_address, BIT(conf.leds.bit) },
+		{ conf.leds.mute_led_address, BIT(conf.leds.bit) },
+		{ conf.kbd_bl.bl_state_address, 0xff },
+	};
+	struct ec_batch *batch = &pm_saved_state;
+	int result = 0;
+	u8 stored;
+
+	BUILD_BUG_ON(ARRAY_SIZE(regs) > EC_BATCH_MAX);
+
+	batch->count = 0;
+	if (!conf_loaded)
+		return 0;
+
+	// save the values the pending writes were meant to set
+	flush_delayed_work(&kbd_bl_work);
+	flush_work(&ec_write_work);
+
+	mutex_lock(&ec_mutex);
+	for (int i = 0; i < ARRAY_SIZE(regs); i++) {
+		if (regs[i].address == MSI_EC_ADDR_UNSUPP)
+			continue;
+
+		result = ec_read_raw(regs[i].address, &stored);
+		if (result < 0)
+			break;
+
+		ec_batch_add(batch, regs[i].address, regs[i].mask, stored);
+	}
+	mutex_unlock(&ec_mutex);
+
+	// not being able to restore the settings shouldn't prevent suspend
+	if (result < 0) {
+		pr_warn("failed to save the EC state: %d\n", result);
+		batch->count = 0;
+	}
+
+	return 0;
+}
+
+static int __maybe_unused msi_ec_resume(struct device *dev)
+{
+	int result;
+
+	if (!conf_loaded)
+		return 0;
+
+	// the EC may have changed anything while the system was asleep
+	mutex_lock(&ec_mutex);
+	bitmap_zero(ec_cache_valid, MSI_EC_RAM_SIZE);
+	mutex_unlock(&ec_mutex);
+
+	// only the registers that differ from the saved values are written
+	result = ec_batch_commit(&pm_saved_state);
+	if (result < 0)
+		pr_warn("failed to restore the EC state: %d\n", result);
+
+	return 0;
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 17, 0))
+static DEFINE_SIMPLE_DEV_PM_OPS(msi_ec_pm_ops, msi_ec_suspend, msi_ec_resume);
+#else
+static SIMPLE_DEV_PM_OPS(msi_ec_pm_ops, msi_ec_suspend, msi_ec_resume);
+#endif
 
 static struct platform_driver msi_platform_driver = {
 	.driver = {
 		.name = MSI_EC_DRIVER_NAME,
 		.dev_groups = msi_platform_groups,
+		.pm = &msi_ec_pm_ops,
 	},
 	.remove = msi_platform_remove,
 };
 
+// ============================================================ //
+// Debugfs
+// ============================================================ //
+
+static struct dentry *msi_debugfs_dir;
+
+static void ec_stats_show_latency(struct seq_file *m, bool write)
+{
+	seq_printf(m, "\n%s latency (us):\n", write ? "write" : "read");
+	for (int i = 0; i < EC_LATENCY_BUCKETS; i++) {
+		unsigned long lower = i ? 1UL << (i - 1) : 0;
+		unsigned long count = write ? ec_addr_stats_sum(write_latency[i])
+					    : ec_addr_stats_sum(read_latency[i]);
+
+		if (i == EC_LATENCY_BUCKETS - 1)
+			seq_printf(m, "[%7lu, inf)     %lu\n", lower, count);
+		else
+			seq_printf(m, "[%7lu, %7lu) %lu\n", lower, 1UL << i,
+				   count);
+	}
+}
+
+// ec_stats. per-address transaction counters and latency histograms
+static int ec_stats_show(struct seq_file *m, void *unused)
+{
+	seq_puts(m, "addr reads writes errors\n");
+	for (int i = 0; i < MSI_EC_RAM_SIZE; i++) {
+		unsigned long reads = ec_addr_stats_sum(reads[i]);
+		unsigned long writes = ec_addr_stats_sum(writes[i]);
+		unsigned long errors = ec_addr_stats_sum(errors[i]);
+
+		if (reads || writes || errors)
+			seq_printf(m, "0x%02x %lu %lu %lu\n",
+				   i, reads, writes, errors);
+	}
+
+	ec_stats_show_latency(m, false);
+	ec_stats_show_latency(m, true);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ec_stats);
+
+static void __init msi_debugfs_init(void)
+{
+	struct ec_addr_stats __percpu *stats;
+
+	msi_debugfs_dir = debugfs_create_dir(MSI_EC_DRIVER_NAME, NULL);
+	if (IS_ERR(msi_debugfs_dir))
+		return;
+
+	// nothing is accounted without it
+	stats = alloc_percpu(struct ec_addr_stats);
+	if (!stats)
+		return;
+
+	WRITE_ONCE(ec_addr_stats, stats);
+	debugfs_create_file("ec_stats", 0400, msi_debugfs_dir, NULL,
+			    &ec_stats_fops);
+}
+
+// called once nothing can access the EC anymore
+static void msi_debugfs_exit(void)
+{
+	debugfs_remove_recursive(msi_debugfs_dir);
+	free_percpu(ec_addr_stats);
+}
+
 // ============================================================ //
 // Module load/unload
 // ============================================================ //
 
+/*
+ * Finds the configuration supporting the firmware version. The lookup runs
+ * once per module load and the tables are small enough for a linear scan to
+ * be cheaper than building any index at runtime.
+ */
+static struct msi_ec_conf * __init find_configuration(const char *ver)
+{
+	for (int i = 0; CONFIGURATIONS[i]; i++) {
+		if (match_string(CONFIGURATIONS[i]->allowed_fw, -1, ver) >= 0)
+			return CONFIGURATIONS[i];
+	}
+
+	return NULL;
+}
+
+// checks that every address of a configuration is either valid or unsupported
+static bool __init conf_addresses_valid(const struct msi_ec_conf *c)
+{
+	const u16 addrs[] = {
+		c->charge_control_address,
+		c->webcam.address,
+		c->webcam.block_address,
+		c->fn_win_swap.address,
+		c->cooler_boost.address,
+		c->shift_mode.address,
+		c->super_battery.address,
+		c->fan_mode.address,
+		c->cpu.rt_temp_address,
+		c->cpu.rt_fan_speed_address,
+		c->gpu.rt_temp_address,
+		c->gpu.rt_fan_speed_address,
+		c->leds.micmute_led_address,
+		c->leds.mute_led_address,
+		c->kbd_bl.bl_mode_address,
+		c->kbd_bl.bl_state_address,
+	};
+	const u8 bits[] = {
+		c->webcam.bit,
+		c->fn_win_swap.bit,
+		c->cooler_boost.bit,
+		c->leds.bit,
+	};
+
+	for (int i = 0; i < ARRAY_SIZE(addrs); i++) {
+		if (addrs[i] >= MSI_EC_RAM_SIZE && addrs[i] != MSI_EC_ADDR_UNSUPP)
+			return false;
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(bits); i++) {
+		if (bits[i] > 7)
+			return false;
+	}
+
+	return true;
+}
+
+static const char *const blob_mode_names[MSI_EC_BLOB_MODE_COUNT] = {
+	[MSI_EC_BLOB_MODE_NONE]     = NULL,
+	[MSI_EC_BLOB_MODE_ECO]      = SM_ECO_NAME,
+	[MSI_EC_BLOB_MODE_COMFORT]  = SM_COMFORT_NAME,
+	[MSI_EC_BLOB_MODE_SPORT]    = SM_SPORT_NAME,
+	[MSI_EC_BLOB_MODE_TURBO]    = SM_TURBO_NAME,
+	[MSI_EC_BLOB_MODE_AUTO]     = FM_AUTO_NAME,
+	[MSI_EC_BLOB_MODE_SILENT]   = FM_SILENT_NAME,
+	[MSI_EC_BLOB_MODE_BASIC]    = FM_BASIC_NAME,
+	[MSI_EC_BLOB_MODE_ADVANCED] = FM_ADVANCED_NAME,
+};
+
+static int __init parse_blob_modes(struct msi_ec_mode *modes,
+				   const struct msi_ec_blob_mode *blob_modes)
+{
+	int count = 0;
+
+	// the remaining entries stay NULL-terminated
+	for (int i = 0; i < MSI_EC_BLOB_MODES; i++) {
+		if (blob_modes[i].name == MSI_EC_BLOB_MODE_NONE)
+			continue;
+
+		if (blob_modes[i].name >= MSI_EC_BLOB_MODE_COUNT)
+			return -EINVAL;
+
+		modes[count].name = blob_mode_names[blob_modes[i].name];
+		modes[count].value = blob_modes[i].value;
+		count++;
+	}
+
+	return 0;
+}
+
+static int __init parse_configuration_blob(struct msi_ec_conf *c,
+					   const struct msi_ec_conf_blob *blob,
+					   const char *ver)
+{
+	int result;
+
+	if (memcmp(blob->magic, MSI_EC_BLOB_MAGIC, sizeof(blob->magic)) ||
+	    blob->version != MSI_EC_BLOB_VERSION)
+		return -EINVAL;
+
+	if (strncmp(blob->fw, ver, MSI_EC_FW_VERSION_LENGTH))
+		return -EINVAL;
+
+	memset(c, 0, sizeof(*c));
+
+	c->charge_control_address = le16_to_cpu(blob->charge_control_address);
+
+	c->webcam.address       = le16_to_cpu(blob->webcam_address);
+	c->webcam.block_address = le16_to_cpu(blob->webcam_block_address);
+	c->webcam.bit           = blob->webcam_bit;
+
+	c->fn_win_swap.address = le16_to_cpu(blob->fn_win_swap_address);
+	c->fn_win_swap.bit     = blob->fn_win_swap_bit;
+	c->fn_win_swap.invert  = blob->fn_win_swap_invert;
+
+	c->cooler_boost.address = le16_to_cpu(blob->cooler_boost_address);
+	c->cooler_boost.bit     = blob->cooler_boost_bit;
+
+	c->shift_mode.address = le16_to_cpu(blob->shift_mode_address);
+	result = parse_blob_modes(c->shift_mode.modes, blob->shift_modes);
+	if (result < 0)
+		return result;
+
+	c->super_battery.address = le16_to_cpu(blob->super_battery_address);
+	c->super_battery.mask    = blob->super_battery_mask;
+
+	c->fan_mode.address = le16_to_cpu(blob->fan_mode_address);
+	result = parse_blob_modes(c->fan_mode.modes, blob->fan_modes);
+	if (result < 0)
+		return result;
+
+	c->cpu.rt_temp_address      = le16_to_cpu(blob->cpu_rt_temp_address);
+	c->cpu.rt_fan_speed_address = le16_to_cpu(blob->cpu_rt_fan_speed_address);
+
+	c->gpu.rt_temp_address      = le16_to_cpu(blob->gpu_rt_temp_address);
+	c->gpu.rt_fan_speed_address = le16_to_cpu(blob->gpu_rt_fan_speed_address);
+
+	c->leds.micmute_led_address = le16_to_cpu(blob->micmute_led_address);
+	c->leds.mute_led_address    = le16_to_cpu(blob->mute_led_address);
+	c->leds.bit                 = blob->leds_bit;
+
+	c->kbd_bl.bl_mode_address  = le16_to_cpu(blob->kbd_bl_mode_address);
+	c->kbd_bl.bl_modes[0]      = blob->kbd_bl_modes[0];
+	c->kbd_bl.bl_modes[1]      = blob->kbd_bl_modes[1];
+	c->kbd_bl.max_mode         = blob->kbd_bl_max_mode;
+	c->kbd_bl.bl_state_address = le16_to_cpu(blob->kbd_bl_state_address);
+	c->kbd_bl.state_base_value = blob->kbd_bl_state_base_value;
+	c->kbd_bl.max_state        = blob->kbd_bl_max_state;
+
+	if (!conf_addresses_valid(c))
+		return -EINVAL;
+
+	return 0;
+}
+
+// loads the configuration from msi-ec/<ver>.bin in the firmware search path
+static int __init load_configuration_blob(const char *ver)
+{
+	const struct firmware *fw;
+	struct msi_ec_conf parsed;
+	char name[32];
+	int result;
+
+	// the version becomes a part of the file path
+	if (strchr(ver, '/'))
+		return -EINVAL;
+
+	snprintf(name, sizeof(name), "msi-ec/%s.bin", ver);
+	result = firmware_request_nowarn(&fw, name, NULL);
+	if (result < 0)
+		return result;
+
+	if (fw->size != sizeof(struct msi_ec_conf_blob))
+		result = -EINVAL;
+	else
+		result = parse_configuration_blob(
+			&parsed, (const struct msi_ec_conf_blob *)fw->data, ver);
+
+	release_firmware(fw);
+
+	if (result == 0)
+		memcpy(&conf, &parsed, sizeof(struct msi_ec_conf));
+
+	if (result == -EINVAL)
+		pr_err("Invalid configuration file %s\n", name);
+	else if (result == 0)
+		pr_info("Loaded the configuration from %s\n", name);
+
+	return result;
+}
+
 // must be called before msi_platform_probe()
 static int __init load_configuration(void)
 {
@@ -4358,6 +7525,7 @@ static int __init load_configuration(void)
 
 	char *ver;
 	char ver_by_ec[MSI_EC_FW_VERSION_LENGTH + 1]; // to store version read from EC
+	struct msi_ec_conf *found;
 
 	if (firmware) {
 		// use fw version passed as a parameter
@@ -4372,15 +7540,18 @@ static int __init load_configuration(void)
 	}
 
 	// load the suitable configuration, if exists
-	for (int i = 0; CONFIGURATIONS[i]; i++) {
-		if (match_string(CONFIGURATIONS[i]->allowed_fw, -1, ver) != -EINVAL) {
-			memcpy(&conf,
-			       CONFIGURATIONS[i],
-			       sizeof(struct msi_ec_conf));
-			conf.allowed_fw = NULL;
-			conf_loaded = true;
-			return 0;
-		}
+	found = find_configuration(ver);
+	if (found) {
+		memcpy(&conf, found, sizeof(struct msi_ec_conf));
+		conf.allowed_fw = NULL;
+		conf_loaded = true;
+		return 0;
+	}
+
+	// fall back to a configuration file for the firmware, if exists
+	if (load_configuration_blob(ver) == 0) {
+		conf_loaded = true;
+		return 0;
 	}
 
 	// debug mode works regardless of whether the firmware is supported
@@ -4391,23 +7562,11 @@ static int __init load_configuration(void)
 	return -EOPNOTSUPP;
 }
 
-static int __init msi_ec_init(void)
+static int charge_control_init(void)
 {
 	int result;
 
-	result = load_configuration();
-	if (result < 0)
-		return result;
-
-	msi_platform_device = platform_create_bundle(&msi_platform_driver,
-						     msi_platform_probe,
-						     NULL, 0, NULL, 0);
-	if (IS_ERR(msi_platform_device))
-		return PTR_ERR(msi_platform_device);
-
-	pr_info("module_init\n");
-	if (!conf_loaded)
-		return 0;
+	charge_control_supported = false;
 
 	/*
 	 * Additional check: battery thresholds are supported only if
@@ -4423,42 +7582,137 @@ static int __init msi_ec_init(void)
 	if (charge_control_supported)
 		battery_hook_register(&battery_hook);
 
-	// register LED classdevs
-	if (conf.leds.micmute_led_address != MSI_EC_ADDR_UNSUPP)
-		led_classdev_register(&msi_platform_device->dev,
-				      &micmute_led_cdev);
+	return 0;
+}
+
+/*
+ * Replaces the live configuration, see debug/conf_override. Everything
+ * derived from it is rebuilt, as on load: the LED classdevs and the
+ * battery hook are registered again, and the attribute visibility is
+ * reevaluated.
+ */
+static int conf_override_apply(const struct msi_ec_conf *new_conf)
+{
+	static DEFINE_MUTEX(conf_override_mutex);
+	int result;
+
+	mutex_lock(&conf_override_mutex);
 
-	if (conf.leds.mute_led_address != MSI_EC_ADDR_UNSUPP)
-		led_classdev_register(&msi_platform_device->dev,
-				      &mute_led_cdev);
+	sampler_stop();
+	fan_curve_clear();
+	msi_leds_unregister();
+	if (charge_control_supported)
+		battery_hook_unregister(&battery_hook);
 
-	if (conf.kbd_bl.bl_state_address != MSI_EC_ADDR_UNSUPP)
-		led_classdev_register(&msi_platform_device->dev,
-				      &msiacpi_led_kbdlight);
+	mutex_lock(&ec_mutex);
+	memcpy(&conf, new_conf, sizeof(conf));
+	bitmap_zero(ec_cache_valid, MSI_EC_RAM_SIZE);
+	mutex_unlock(&ec_mutex);
 
-	return 0;
+	mode_tables_init();
+	msi_ec_visibility_init();
+
+	result = charge_control_init();
+	shadow_init();
+	msi_leds_register();
+
+	sampler_primed = false;
+	sampler_start();
+
+	if (result == 0)
+		result = sysfs_update_groups(&msi_platform_device->dev.kobj,
+					     msi_platform_groups);
+
+	mutex_unlock(&conf_override_mutex);
+
+	return result;
+}
+
+// makes the emulated EC report the loaded configuration's firmware
+static void __init ec_mock_seed(void)
+{
+	if (firmware)
+		memcpy(ec_mock_ram + MSI_EC_FW_VERSION_ADDRESS, firmware,
+		       min_t(size_t, strlen(firmware), MSI_EC_FW_VERSION_LENGTH));
+
+	// enabled charge control, 100% threshold
+	if (conf_loaded && conf.charge_control_address != MSI_EC_ADDR_UNSUPP)
+		ec_mock_ram[conf.charge_control_address] = BIT(7) | 100;
 }
 
-static void __exit msi_ec_exit(void)
+static int __init __maybe_unused msi_ec_init(void)
 {
+	int result;
+
+	if (mock) {
+		pr_warn("using an emulated EC\n");
+		ec_ops = &msi_ec_mock_ops;
+	}
+
+	result = load_configuration();
+	if (result < 0)
+		return result;
+
+	if (mock)
+		ec_mock_seed();
+
 	if (conf_loaded) {
-		// unregister LED classdevs
-		if (conf.leds.micmute_led_address != MSI_EC_ADDR_UNSUPP)
-			led_classdev_unregister(&micmute_led_cdev);
+		mode_tables_init();
+		msi_ec_visibility_init();
+	}
 
-		if (conf.leds.mute_led_address != MSI_EC_ADDR_UNSUPP)
-			led_classdev_unregister(&mute_led_cdev);
+	msi_platform_device = platform_create_bundle(&msi_platform_driver,
+						     msi_platform_probe,
+						     NULL, 0, NULL, 0);
+	if (IS_ERR(msi_platform_device))
+		return PTR_ERR(msi_platform_device);
+
+	msi_debugfs_init();
+
+	pr_info("module_init\n");
+	if (!conf_loaded)
+		return 0;
+
+	result = charge_control_init();
+	if (result < 0)
+		goto err_unregister;
+
+	shadow_init();
+	ec_write_wq_init();
+
+	msi_leds_register();
+
+	sampler_start();
+
+	return 0;
+
+err_unregister:
+	// as on unload, debugfs goes last
+	platform_device_unregister(msi_platform_device);
+	platform_driver_unregister(&msi_platform_driver);
+	msi_debugfs_exit();
+
+	return result;
+}
+
+static void __exit __maybe_unused msi_ec_exit(void)
+{
+	if (conf_loaded) {
+		sampler_stop();
 
-		if (conf.kbd_bl.bl_state_address != MSI_EC_ADDR_UNSUPP)
-			led_classdev_unregister(&msiacpi_led_kbdlight);
+		msi_leds_unregister();
 
 		if (charge_control_supported)
 			battery_hook_unregister(&battery_hook);
+
+		ec_write_wq_exit();
 	}
 
 	platform_device_unregister(msi_platform_device);
 	platform_driver_unregister(&msi_platform_driver);
 
+	msi_debugfs_exit();
+
 	pr_info("module_exit\n");
 }
 
@@ -4466,8 +7720,11 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Jose Angel Pastrana <japp0005@red.ujaen.es>");
 MODULE_AUTHOR("Aakash Singh <mail@singhaakash.dev>");
 MODULE_AUTHOR("Nikita Kravets <teackot@gmail.com>");
-MODULE_DESCRIPTION("MSI Embedded Controller");
 MODULE_VERSION("0.09");
 
+#ifndef MSI_EC_TEST
+MODULE_DESCRIPTION("MSI Embedded Controller");
+
 module_init(msi_ec_init);
 module_exit(msi_ec_exit);
+#endif
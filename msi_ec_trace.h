@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+
+/*
+ * msi_ec_trace.h - Tracepoints for the EC transactions made by msi-ec.
+ *
+ * Enable with:
+ *   echo 1 > /sys/kernel/tracing/events/msi_ec/enable
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM msi_ec
+
+#if !defined(__MSI_EC_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __MSI_EC_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(msi_ec_access,
+
+	TP_PROTO(u8 addr, u8 value, int result, u64 duration_ns,
+		 unsigned long caller),
+
+	TP_ARGS(addr, value, result, duration_ns, caller),
+
+	TP_STRUCT__entry(
+		__field(u8, addr)
+		__field(u8, value)
+		__field(int, result)
+		__field(u64, duration_ns)
+		__field(unsigned long, caller)
+	),
+
+	TP_fast_assign(
+		__entry->addr        = addr;
+		__entry->value       = value;
+		__entry->result      = result;
+		__entry->duration_ns = duration_ns;
+		__entry->caller      = caller;
+	),
+
+	TP_printk("addr=0x%02x value=0x%02x result=%d duration_ns=%llu caller=%pS",
+		  __entry->addr, __entry->value, __entry->result,
+		  __entry->duration_ns, (void *)__entry->caller)
+);
+
+DEFINE_EVENT(msi_ec_access, msi_ec_read,
+	TP_PROTO(u8 addr, u8 value, int result, u64 duration_ns,
+		 unsigned long caller),
+	TP_ARGS(addr, value, result, duration_ns, caller)
+);
+
+DEFINE_EVENT(msi_ec_access, msi_ec_write,
+	TP_PROTO(u8 addr, u8 value, int result, u64 duration_ns,
+		 unsigned long caller),
+	TP_ARGS(addr, value, result, duration_ns, caller)
+);
+
+#endif // __MSI_EC_TRACE_H__
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE msi_ec_trace
+#include <trace/define_trace.h>
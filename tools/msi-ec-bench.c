@@ -0,0 +1,365 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * msi-ec-bench: measures the cost of the msi-ec sysfs interface.
+ *
+ * Every selected attribute is hammered by several threads at once for a
+ * fixed time, then its throughput and latency percentiles are reported.
+ * Reads use pread() at offset 0 on a descriptor kept open, so every read
+ * is a call to the show handler. With -w, writable attributes are also
+ * written with the value they hold, which exercises the store handlers
+ * without changing any setting. debug/ec_set writes back the byte held
+ * at EC_SET_ADDRESS.
+ *
+ * Build with "make bench", run as root with the module loaded.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MSI_EC_SYSFS "/sys/devices/platform/msi-ec/"
+#define KBD_BL_SYSFS "/sys/class/leds/msiacpi::kbd_backlight/"
+
+#define BUF_SIZE 4096
+
+// part of the firmware version, which the EC never changes
+#define EC_SET_ADDRESS 0xa0
+
+static const char *const default_attrs[] = {
+	MSI_EC_SYSFS "webcam",
+	MSI_EC_SYSFS "fn_key",
+	MSI_EC_SYSFS "cooler_boost",
+	MSI_EC_SYSFS "shift_mode",
+	MSI_EC_SYSFS "super_battery",
+	MSI_EC_SYSFS "fan_mode",
+	MSI_EC_SYSFS "fw_version",
+	MSI_EC_SYSFS "fw_release_date",
+	MSI_EC_SYSFS "cpu/realtime_temperature",
+	MSI_EC_SYSFS "cpu/realtime_fan_speed",
+	MSI_EC_SYSFS "gpu/realtime_temperature",
+	MSI_EC_SYSFS "gpu/realtime_fan_speed",
+	MSI_EC_SYSFS "debug/ec_dump",
+	MSI_EC_SYSFS "debug/ec_get",
+	MSI_EC_SYSFS "debug/ec_set",
+	KBD_BL_SYSFS "brightness",
+	"/sys/class/leds/platform::mute/brightness",
+	"/sys/class/leds/platform::micmute/brightness",
+	NULL
+};
+
+struct bench_thread {
+	pthread_t thread;
+	const char *path;
+	bool write;
+	char value[BUF_SIZE]; // written back with -w
+	size_t value_len;
+
+	uint64_t *samples; // latencies in nanoseconds
+	size_t count;
+	size_t capacity;
+	unsigned long errors;
+};
+
+static volatile bool running;
+
+static unsigned int threads_count = 4;
+static unsigned int duration_s = 2;
+static bool write_mode;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int record(struct bench_thread *bt, uint64_t duration)
+{
+	if (bt->count == bt->capacity) {
+		size_t capacity = bt->capacity ? bt->capacity * 2 : 4096;
+		uint64_t *samples = realloc(bt->samples,
+					    capacity * sizeof(*samples));
+
+		if (!samples)
+			return -ENOMEM;
+
+		bt->samples = samples;
+		bt->capacity = capacity;
+	}
+
+	bt->samples[bt->count++] = duration;
+	return 0;
+}
+
+static void *bench_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	char buf[BUF_SIZE];
+	uint64_t start;
+	ssize_t result;
+	int fd;
+
+	fd = open(bt->path, bt->write ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		bt->errors++;
+		return NULL;
+	}
+
+	while (running) {
+		start = now_ns();
+		if (bt->write)
+			result = pwrite(fd, bt->value, bt->value_len, 0);
+		else
+			result = pread(fd, buf, sizeof(buf), 0);
+
+		if (result < 0)
+			bt->errors++;
+		else if (record(bt, now_ns() - start) < 0)
+			break;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t *samples, size_t count, int p)
+{
+	if (!count)
+		return 0;
+
+	return samples[(count - 1) * p / 100] / 1000.0;
+}
+
+static bool has_suffix(const char *str, const char *suffix)
+{
+	size_t len = strlen(str);
+	size_t suffix_len = strlen(suffix);
+
+	return len >= suffix_len && !strcmp(str + len - suffix_len, suffix);
+}
+
+// reads the current value, so that writing it back changes nothing
+static ssize_t read_value(const char *path, char *buf, size_t size)
+{
+	ssize_t len;
+	int fd;
+
+	// write-only, write the byte it would change back
+	if (has_suffix(path, "/debug/ec_set")) {
+		unsigned char byte;
+
+		fd = open(MSI_EC_SYSFS "debug/ec_ram", O_RDONLY);
+		if (fd < 0)
+			return -errno;
+
+		len = pread(fd, &byte, 1, EC_SET_ADDRESS);
+		close(fd);
+		if (len < 0)
+			return -errno;
+		if (len != 1)
+			return -EIO;
+
+		return snprintf(buf, size, "%02x=%02x\n", EC_SET_ADDRESS, byte);
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+
+	len = read(fd, buf, size - 1);
+	close(fd);
+	if (len < 0)
+		return -errno;
+
+	buf[len] = '\0';
+	return len;
+}
+
+static int run(const char *path, bool write)
+{
+	struct bench_thread *bts;
+	unsigned long errors = 0;
+	uint64_t *all;
+	size_t total = 0;
+	unsigned int started;
+	const char *name;
+	int result = 0;
+
+	bts = calloc(threads_count, sizeof(*bts));
+	if (!bts)
+		return -ENOMEM;
+
+	for (unsigned int i = 0; i < threads_count; i++) {
+		bts[i].path = path;
+		bts[i].write = write;
+	}
+
+	if (write) {
+		ssize_t len = read_value(path, bts[0].value,
+					 sizeof(bts[0].value));
+
+		if (len < 0) {
+			free(bts);
+			return len;
+		}
+
+		for (unsigned int i = 1; i < threads_count; i++) {
+			memcpy(bts[i].value, bts[0].value, len + 1);
+			bts[i].value_len = len;
+		}
+		bts[0].value_len = len;
+	}
+
+	running = true;
+	for (started = 0; started < threads_count; started++) {
+		result = pthread_create(&bts[started].thread, NULL, bench_fn,
+					&bts[started]);
+		if (result) {
+			result = -result;
+			break;
+		}
+	}
+
+	if (result == 0)
+		sleep(duration_s);
+	running = false;
+
+	for (unsigned int i = 0; i < started; i++) {
+		pthread_join(bts[i].thread, NULL);
+		total += bts[i].count;
+		errors += bts[i].errors;
+	}
+
+	if (result < 0)
+		goto out;
+
+	all = malloc((total ? total : 1) * sizeof(*all));
+	if (!all) {
+		result = -ENOMEM;
+		goto out;
+	}
+
+	total = 0;
+	for (unsigned int i = 0; i < threads_count; i++) {
+		memcpy(all + total, bts[i].samples,
+		       bts[i].count * sizeof(*all));
+		total += bts[i].count;
+	}
+	qsort(all, total, sizeof(*all), compare_u64);
+
+	name = strncmp(path, MSI_EC_SYSFS, strlen(MSI_EC_SYSFS)) ?
+	       path : path + strlen(MSI_EC_SYSFS);
+	printf("%-40s %-5s %10zu %10.0f %10.1f %10.1f %8lu\n",
+	       name, write ? "write" : "read", total,
+	       (double)total / duration_s,
+	       percentile_us(all, total, 50), percentile_us(all, total, 99),
+	       errors);
+
+	free(all);
+out:
+	for (unsigned int i = 0; i < threads_count; i++)
+		free(bts[i].samples);
+	free(bts);
+
+	return result;
+}
+
+// access() always succeeds for root, check the mode instead
+static bool has_mode(const char *path, mode_t mode)
+{
+	struct stat st;
+
+	return stat(path, &st) == 0 && (st.st_mode & mode);
+}
+
+static bool can_write_back(const char *path)
+{
+	// writing the value read selects another address
+	if (has_suffix(path, "/debug/ec_get"))
+		return false;
+
+	return has_mode(path, S_IWUSR);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t threads] [-d seconds] [-w] [attribute...]\n"
+		"\n"
+		"  -t  number of concurrent threads per attribute (default: %u)\n"
+		"  -d  duration of each run in seconds (default: %u)\n"
+		"  -w  also write the current value back to writable attributes\n"
+		"\n"
+		"Attributes are sysfs paths; without any, all known msi-ec\n"
+		"attributes and LEDs present on the system are measured.\n",
+		prog, threads_count, duration_s);
+}
+
+int main(int argc, char **argv)
+{
+	const char *const *attrs = default_attrs;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:d:wh")) != -1) {
+		switch (opt) {
+		case 't':
+			threads_count = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			duration_s = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			write_mode = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!threads_count || !duration_s) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (optind < argc)
+		attrs = (const char *const *)&argv[optind];
+
+	printf("%-40s %-5s %10s %10s %10s %10s %8s\n", "attribute", "op",
+	       "ops", "ops/s", "p50 (us)", "p99 (us)", "errors");
+
+	for (int i = 0; attrs[i]; i++) {
+		int result = 0;
+
+		if (access(attrs[i], F_OK) < 0)
+			continue;
+
+		if (has_mode(attrs[i], S_IRUSR))
+			result = run(attrs[i], false);
+		if (result == 0 && write_mode && can_write_back(attrs[i]))
+			result = run(attrs[i], true);
+
+		if (result < 0)
+			fprintf(stderr, "%s: %s\n", attrs[i], strerror(-result));
+	}
+
+	return 0;
+}